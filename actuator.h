@@ -0,0 +1,337 @@
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+/*
+ * Lock actuator driver
+ *
+ * The latch servo is driven by the LEDC hardware PWM, so the pulse train is
+ * generated without CPU involvement. Moves follow a trapezoidal
+ * acceleration profile that is evaluated from the elapsed time on every
+ * handleActuator() call: loop() is never blocked and a late call simply
+ * catches up with the profile.
+ *
+ * The servo supply is switched by a MOSFET and only enabled while moving.
+ * Its current is measured on a shunt: a current above the stall threshold
+ * for too long stops the move and powers the servo down.
+ */
+
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include "board.h"
+#include "lifetime.h"
+
+// Configuration constants
+const uint8_t ACTUATOR_PWM_PIN = Board::ACTUATOR_PWM_PIN;            // Servo signal
+const uint8_t ACTUATOR_POWER_PIN = Board::ACTUATOR_POWER_PIN;          // Servo supply MOSFET gate (HIGH = powered)
+const uint8_t ACTUATOR_CURRENT_PIN = Board::ACTUATOR_CURRENT_PIN;        // Shunt amplifier output (ADC1)
+
+const ledc_mode_t ACTUATOR_LEDC_MODE = LEDC_HIGH_SPEED_MODE;
+const ledc_timer_t ACTUATOR_LEDC_TIMER = LEDC_TIMER_0;
+const ledc_channel_t ACTUATOR_LEDC_CHANNEL = LEDC_CHANNEL_0;
+const uint32_t ACTUATOR_PWM_FREQUENCY = 50;       // Standard servo frame rate (20 ms)
+const uint32_t ACTUATOR_PWM_PERIOD_US = 1000000 / ACTUATOR_PWM_FREQUENCY;
+const uint32_t ACTUATOR_PWM_MAX_DUTY = (1 << 16) - 1;  // 16 bit resolution
+
+const uint16_t ACTUATOR_CLOSED_PULSE_US = 1000;   // Servo pulse width with latch closed
+const uint16_t ACTUATOR_OPEN_PULSE_US = 2000;     // Servo pulse width with latch open
+const float ACTUATOR_MAX_SPEED = 8000.0;          // Pulse width change per second (us/s)
+const float ACTUATOR_ACCELERATION = 80000.0;      // Pulse width change per second^2 (us/s^2)
+
+const uint32_t ACTUATOR_POWER_UP_US = 20000;      // Supply settling before the first pulse counts
+const uint32_t ACTUATOR_SETTLE_US = 100000;       // Hold time at target before powering down
+const uint32_t ACTUATOR_CURRENT_SAMPLE_US = 5000; // Current sampling period while powered
+const uint32_t ACTUATOR_INRUSH_US = 40000;        // Ignore current peaks right after power up
+const uint32_t ACTUATOR_STALL_MA = 700;           // Current considered a stall
+const uint32_t ACTUATOR_STALL_US = 60000;         // Stall current duration that aborts the move
+const float ACTUATOR_SHUNT_MV_PER_MA = 1.0;       // Shunt amplifier gain
+const uint32_t ACTUATOR_LATENCY_BUDGET_US = 400000;  // Trigger to latch open target
+
+// Actuator state machine
+enum ActuatorState {
+  ACTUATOR_IDLE,      // Powered down, holding position mechanically
+  ACTUATOR_MOVING,    // Following the motion profile
+  ACTUATOR_SETTLING,  // At target, waiting before power down
+  ACTUATOR_FAULT      // Move aborted by stall detection
+};
+
+// What requested a move (used for the latency report)
+enum ActuatorTrigger {
+  ACTUATOR_TRIGGER_MANUAL,
+  ACTUATOR_TRIGGER_SCHEDULE,
+  ACTUATOR_TRIGGER_TAG
+};
+
+// Global variables
+ActuatorState actuatorState = ACTUATOR_IDLE;
+ActuatorTrigger actuatorTrigger = ACTUATOR_TRIGGER_MANUAL;
+float actuatorPosition = ACTUATOR_CLOSED_PULSE_US;  // Current pulse width (us)
+float actuatorFrom = ACTUATOR_CLOSED_PULSE_US;      // Profile start position
+float actuatorTo = ACTUATOR_CLOSED_PULSE_US;        // Profile target position
+float actuatorAccelTime = 0;                        // Profile acceleration phase (s)
+float actuatorCruiseTime = 0;                       // Profile constant speed phase (s)
+float actuatorPeakSpeed = 0;                        // Profile peak speed (us/s)
+uint32_t actuatorPowerOnTime = 0;
+uint32_t actuatorMoveStart = 0;
+uint32_t actuatorSettleStart = 0;
+uint32_t actuatorLastCurrentSample = 0;
+uint32_t actuatorStallStart = 0;
+bool actuatorStallDetected = false;
+uint32_t actuatorTriggerTime = 0;                   // esp_timer time of the open request
+bool actuatorLatencyPending = false;
+uint32_t actuatorLastLatency = 0;                   // Last trigger to latch open time (us)
+uint32_t actuatorMaxLatency = 0;
+uint32_t actuatorCycles = 0;
+
+void initializeActuator();
+void handleActuator();
+bool isActuatorBusy();
+void actuatorOpen(ActuatorTrigger trigger, uint32_t triggerTime);
+void actuatorClose(ActuatorTrigger trigger);
+void actuatorMoveTo(float target);
+void actuatorPowerDown();
+void actuatorWritePulse(float pulseWidth);
+float actuatorProfilePosition(float elapsed);
+uint32_t readActuatorCurrent();
+void onActuatorTargetReached(uint32_t now);
+String getActuatorStateString(ActuatorState state);
+
+/**
+ * Configure PWM timer, channel and supply switch
+ * The servo stays unpowered until the first move
+ */
+void initializeActuator() {
+  pinMode(ACTUATOR_POWER_PIN, OUTPUT);
+  digitalWrite(ACTUATOR_POWER_PIN, LOW);
+
+  ledc_timer_config_t timerConfig = {};
+  timerConfig.speed_mode = ACTUATOR_LEDC_MODE;
+  timerConfig.duty_resolution = LEDC_TIMER_16_BIT;
+  timerConfig.timer_num = ACTUATOR_LEDC_TIMER;
+  timerConfig.freq_hz = ACTUATOR_PWM_FREQUENCY;
+  timerConfig.clk_cfg = LEDC_AUTO_CLK;
+  ledc_timer_config(&timerConfig);
+
+  ledc_channel_config_t channelConfig = {};
+  channelConfig.gpio_num = ACTUATOR_PWM_PIN;
+  channelConfig.speed_mode = ACTUATOR_LEDC_MODE;
+  channelConfig.channel = ACTUATOR_LEDC_CHANNEL;
+  channelConfig.intr_type = LEDC_INTR_DISABLE;
+  channelConfig.timer_sel = ACTUATOR_LEDC_TIMER;
+  channelConfig.duty = 0;
+  channelConfig.hpoint = 0;
+  ledc_channel_config(&channelConfig);
+  ledc_stop(ACTUATOR_LEDC_MODE, ACTUATOR_LEDC_CHANNEL, 0);
+
+  Serial.print("Actuator ready on GPIO");
+  Serial.print(ACTUATOR_PWM_PIN);
+  Serial.print(" (power GPIO");
+  Serial.print(ACTUATOR_POWER_PIN);
+  Serial.println(")");
+}
+
+/**
+ * Advance the motion profile, monitor the current and power down when done
+ * Called on every loop() iteration, never blocks
+ */
+void handleActuator() {
+  if (actuatorState == ACTUATOR_IDLE || actuatorState == ACTUATOR_FAULT) {
+    return;
+  }
+
+  uint32_t now = (uint32_t)esp_timer_get_time();
+
+  // Stall detection on the shunt current
+  if (now - actuatorLastCurrentSample >= ACTUATOR_CURRENT_SAMPLE_US &&
+      now - actuatorPowerOnTime >= ACTUATOR_INRUSH_US) {
+    actuatorLastCurrentSample = now;
+    if (readActuatorCurrent() >= ACTUATOR_STALL_MA) {
+      if (!actuatorStallDetected) {
+        actuatorStallDetected = true;
+        actuatorStallStart = now;
+      } else if (now - actuatorStallStart >= ACTUATOR_STALL_US) {
+        Serial.println("✗ Actuator stall detected - move aborted");
+        actuatorPowerDown();
+        actuatorState = ACTUATOR_FAULT;
+        actuatorLatencyPending = false;
+        return;
+      }
+    } else {
+      actuatorStallDetected = false;
+    }
+  }
+
+  if (actuatorState == ACTUATOR_MOVING) {
+    // Profile starts once the supply has settled
+    if ((int32_t)(now - actuatorMoveStart) < 0) {
+      return;
+    }
+
+    float elapsed = (now - actuatorMoveStart) / 1000000.0;
+    float duration = 2 * actuatorAccelTime + actuatorCruiseTime;
+    if (elapsed >= duration) {
+      actuatorWritePulse(actuatorTo);
+      onActuatorTargetReached(now);
+    } else {
+      actuatorWritePulse(actuatorProfilePosition(elapsed));
+    }
+  } else if (actuatorState == ACTUATOR_SETTLING) {
+    if (now - actuatorSettleStart >= ACTUATOR_SETTLE_US) {
+      actuatorPowerDown();
+      actuatorState = ACTUATOR_IDLE;
+    }
+  }
+}
+
+/**
+ * True while a move or its settle time is in progress
+ * A faulted actuator is already powered down and does not count as busy
+ */
+bool isActuatorBusy() {
+  return actuatorState == ACTUATOR_MOVING || actuatorState == ACTUATOR_SETTLING;
+}
+
+/**
+ * Request the latch to open
+ * @param trigger Source of the request
+ * @param triggerTime esp_timer time (us) of the originating event, used to
+ *                    measure the trigger to latch open latency
+ */
+void actuatorOpen(ActuatorTrigger trigger, uint32_t triggerTime) {
+  actuatorTrigger = trigger;
+  actuatorTriggerTime = triggerTime;
+  actuatorLatencyPending = true;
+  actuatorMoveTo(ACTUATOR_OPEN_PULSE_US);
+}
+
+/**
+ * Request the latch to close
+ */
+void actuatorClose(ActuatorTrigger trigger) {
+  actuatorTrigger = trigger;
+  actuatorLatencyPending = false;
+  actuatorMoveTo(ACTUATOR_CLOSED_PULSE_US);
+}
+
+/**
+ * Plan a trapezoidal profile from the current position to the target
+ * Falls back to a triangular profile when the distance is too short to
+ * reach the maximum speed
+ */
+void actuatorMoveTo(float target) {
+  uint32_t now = (uint32_t)esp_timer_get_time();
+
+  actuatorFrom = actuatorPosition;
+  actuatorTo = target;
+  actuatorStallDetected = false;
+
+  float distance = fabsf(actuatorTo - actuatorFrom);
+  float accelDistance = ACTUATOR_MAX_SPEED * ACTUATOR_MAX_SPEED / (2 * ACTUATOR_ACCELERATION);
+  if (2 * accelDistance >= distance) {
+    actuatorAccelTime = sqrtf(distance / ACTUATOR_ACCELERATION);
+    actuatorPeakSpeed = ACTUATOR_ACCELERATION * actuatorAccelTime;
+    actuatorCruiseTime = 0;
+  } else {
+    actuatorAccelTime = ACTUATOR_MAX_SPEED / ACTUATOR_ACCELERATION;
+    actuatorPeakSpeed = ACTUATOR_MAX_SPEED;
+    actuatorCruiseTime = (distance - 2 * accelDistance) / ACTUATOR_MAX_SPEED;
+  }
+
+  // Power up holding the current position, then start the profile
+  if (actuatorState == ACTUATOR_IDLE || actuatorState == ACTUATOR_FAULT) {
+    actuatorWritePulse(actuatorPosition);
+    digitalWrite(ACTUATOR_POWER_PIN, HIGH);
+    actuatorPowerOnTime = now;
+    actuatorMoveStart = now + ACTUATOR_POWER_UP_US;
+    actuatorCycles++;
+    lifetimeIncrement(LIFETIME_ACTUATOR_CYCLES);
+  } else {
+    actuatorMoveStart = now;
+  }
+  actuatorLastCurrentSample = now;
+  actuatorState = ACTUATOR_MOVING;
+}
+
+/**
+ * Position along the planned profile
+ * @param elapsed Time since the profile start in seconds
+ * @return Pulse width in microseconds
+ */
+float actuatorProfilePosition(float elapsed) {
+  float duration = 2 * actuatorAccelTime + actuatorCruiseTime;
+  float travelled;
+
+  if (elapsed < actuatorAccelTime) {
+    travelled = 0.5 * ACTUATOR_ACCELERATION * elapsed * elapsed;
+  } else if (elapsed < actuatorAccelTime + actuatorCruiseTime) {
+    travelled = 0.5 * actuatorPeakSpeed * actuatorAccelTime + actuatorPeakSpeed * (elapsed - actuatorAccelTime);
+  } else {
+    float remaining = duration - elapsed;
+    travelled = fabsf(actuatorTo - actuatorFrom) - 0.5 * ACTUATOR_ACCELERATION * remaining * remaining;
+  }
+
+  return (actuatorTo >= actuatorFrom) ? actuatorFrom + travelled : actuatorFrom - travelled;
+}
+
+/**
+ * Target position reached: record the latency and start settling
+ */
+void onActuatorTargetReached(uint32_t now) {
+  actuatorState = ACTUATOR_SETTLING;
+  actuatorSettleStart = now;
+
+  if (actuatorLatencyPending) {
+    actuatorLatencyPending = false;
+    actuatorLastLatency = now - actuatorTriggerTime;
+    if (actuatorLastLatency > actuatorMaxLatency) {
+      actuatorMaxLatency = actuatorLastLatency;
+    }
+
+    Serial.print("✓ Latch open in ");
+    Serial.print(actuatorLastLatency / 1000);
+    Serial.print(" ms (budget ");
+    Serial.print(ACTUATOR_LATENCY_BUDGET_US / 1000);
+    Serial.println(" ms)");
+    if (actuatorLastLatency > ACTUATOR_LATENCY_BUDGET_US) {
+      Serial.println("⚠ Latch open latency over budget");
+    }
+  }
+}
+
+/**
+ * Stop the pulse train and cut the servo supply
+ */
+void actuatorPowerDown() {
+  ledc_stop(ACTUATOR_LEDC_MODE, ACTUATOR_LEDC_CHANNEL, 0);
+  digitalWrite(ACTUATOR_POWER_PIN, LOW);
+}
+
+/**
+ * Update the hardware PWM duty for the given servo pulse width
+ */
+void actuatorWritePulse(float pulseWidth) {
+  actuatorPosition = pulseWidth;
+  uint32_t duty = (uint32_t)(pulseWidth * ACTUATOR_PWM_MAX_DUTY / ACTUATOR_PWM_PERIOD_US);
+  ledc_set_duty(ACTUATOR_LEDC_MODE, ACTUATOR_LEDC_CHANNEL, duty);
+  ledc_update_duty(ACTUATOR_LEDC_MODE, ACTUATOR_LEDC_CHANNEL);
+}
+
+/**
+ * Read the servo supply current
+ * @return Current in mA
+ */
+uint32_t readActuatorCurrent() {
+  return analogReadMilliVolts(ACTUATOR_CURRENT_PIN) / ACTUATOR_SHUNT_MV_PER_MA;
+}
+
+// Utility functions
+String getActuatorStateString(ActuatorState state) {
+  switch (state) {
+    case ACTUATOR_IDLE: return "IDLE";
+    case ACTUATOR_MOVING: return "MOVING";
+    case ACTUATOR_SETTLING: return "SETTLING";
+    case ACTUATOR_FAULT: return "FAULT";
+    default: return "UNKNOWN";
+  }
+}
+
+#endif // ACTUATOR_H
@@ -0,0 +1,77 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+/*
+ * Battery monitoring
+ *
+ * The battery voltage is read on an ADC1 pin through a 1:2 resistor divider
+ * (ADC1 keeps working while WiFi is on). A low battery is reported with
+ * hysteresis so the status does not flicker around the threshold.
+ */
+
+#include "board.h"
+#include "metrics.h"
+
+// Configuration constants
+const uint8_t BATTERY_PIN = Board::BATTERY_PIN;
+const uint32_t BATTERY_DIVIDER_RATIO = 2;
+const uint8_t BATTERY_SAMPLES = 8;                  // Averaged per reading
+const uint32_t BATTERY_LOW_MV = 3500;               // Single cell LiPo, about 10% left
+const uint32_t BATTERY_RECOVERED_MV = 3600;         // Low status cleared above this
+const uint32_t BATTERY_CHECK_INTERVAL_MS = 60000;
+
+// Global variables
+uint32_t batteryMillivolts = 0;
+bool batteryLow = false;
+
+/**
+ * Read the battery voltage, averaged over BATTERY_SAMPLES
+ * @return Battery voltage in millivolts
+ */
+uint32_t readBatteryMillivolts() {
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < BATTERY_SAMPLES; i++) {
+    sum += analogReadMilliVolts(BATTERY_PIN);
+  }
+  return sum / BATTERY_SAMPLES * BATTERY_DIVIDER_RATIO;
+}
+
+/**
+ * Read the battery and update the low status
+ */
+void updateBattery() {
+  batteryMillivolts = readBatteryMillivolts();
+  metricBatteryMillivolts = batteryMillivolts;
+
+  if (!batteryLow && batteryMillivolts < BATTERY_LOW_MV) {
+    batteryLow = true;
+    Serial.print("⚠ Battery low: ");
+    Serial.print(batteryMillivolts);
+    Serial.println(" mV");
+  } else if (batteryLow && batteryMillivolts > BATTERY_RECOVERED_MV) {
+    batteryLow = false;
+    Serial.println("✓ Battery recovered");
+  }
+}
+
+void initializeBattery() {
+  analogSetPinAttenuation(BATTERY_PIN, ADC_11db);  // Up to about 3.1 V at the pin
+  updateBattery();
+
+  Serial.print("Battery: ");
+  Serial.print(batteryMillivolts);
+  Serial.println(" mV");
+}
+
+/**
+ * Periodic battery check, called from loop()
+ */
+void handleBattery() {
+  static uint32_t lastCheck = 0;
+  if (millis() - lastCheck >= BATTERY_CHECK_INTERVAL_MS) {
+    lastCheck = millis();
+    updateBattery();
+  }
+}
+
+#endif // BATTERY_H
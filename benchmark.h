@@ -0,0 +1,219 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/*
+ * Microbenchmark suite
+ *
+ * Enabled by defining ENABLE_BENCHMARKS before this header is included.
+ * The suite runs once at boot and measures the request handlers, the
+ * configuration storage, the date formatting helpers and one step of the
+ * WiFi state machine. Results are printed on the serial port as a single
+ * JSON document (Google Benchmark layout) delimited by BENCHMARK_BEGIN and
+ * BENCHMARK_END markers, so they can be captured and compared across
+ * releases.
+ *
+ * The configuration benchmarks run on a copy: the NVS ones write to the
+ * scratch "benchmark" namespace, and config is restored afterwards, so
+ * the saved networks and settings are never touched.
+ *
+ * Time is measured with the CPU cycle counter. Heap allocations per call
+ * are counted through the ESP-IDF heap hooks when the core is built with
+ * CONFIG_HEAP_USE_HOOKS, otherwise only the heap retained per call is
+ * reported and "allocs_per_iteration" is null.
+ */
+
+#ifdef ENABLE_BENCHMARKS
+
+// Configuration constants
+const uint16_t BENCHMARK_MAX_SAMPLES = 128;    // Samples kept for percentiles
+const uint16_t BENCHMARK_ITERATIONS = 100;     // Iterations for RAM only benchmarks
+const uint16_t BENCHMARK_NVS_ITERATIONS = 10;  // Iterations for benchmarks writing flash
+
+/**
+ * Result of a single benchmark
+ */
+struct BenchmarkResult {
+  const char* name;
+  uint16_t iterations;
+  uint32_t meanNs;         // Mean time per call
+  uint32_t p50Ns;          // Median time per call
+  uint32_t p90Ns;          // 90th percentile time per call
+  uint32_t maxNs;          // Slowest call
+  float allocsPerCall;     // Heap allocations per call (-1 if not available)
+  int32_t retainedBytes;   // Heap not returned after all calls
+};
+
+// Global variables
+uint32_t benchmarkSamples[BENCHMARK_MAX_SAMPLES];
+volatile uint32_t benchmarkAllocCount = 0;
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+// Called by the heap implementation on every allocation and free
+void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) {
+  benchmarkAllocCount++;
+}
+
+void IRAM_ATTR esp_heap_trace_free_hook(void* ptr) {
+}
+#endif
+
+/**
+ * Time a function over a number of iterations
+ * @param name Benchmark name used in the report
+ * @param iterations Number of calls (at most BENCHMARK_MAX_SAMPLES)
+ * @param fn Function under test
+ */
+template <typename Function>
+BenchmarkResult runBenchmark(const char* name, uint16_t iterations, Function fn) {
+  BenchmarkResult result;
+  result.name = name;
+  result.iterations = min(iterations, BENCHMARK_MAX_SAMPLES);
+
+  // Warm up caches and lazy initializations
+  fn();
+
+  uint32_t cyclesPerUs = ESP.getCpuFreqMHz();
+  uint32_t freeBefore = ESP.getFreeHeap();
+  uint32_t allocsBefore = benchmarkAllocCount;
+  uint64_t totalNs = 0;
+
+  for (uint16_t i = 0; i < result.iterations; i++) {
+    uint32_t start = ESP.getCycleCount();
+    fn();
+    uint32_t cycles = ESP.getCycleCount() - start;
+    benchmarkSamples[i] = (uint64_t)cycles * 1000 / cyclesPerUs;
+    totalNs += benchmarkSamples[i];
+  }
+
+  result.retainedBytes = (int32_t)(freeBefore - ESP.getFreeHeap());
+#ifdef CONFIG_HEAP_USE_HOOKS
+  result.allocsPerCall = (float)(benchmarkAllocCount - allocsBefore) / result.iterations;
+#else
+  (void)allocsBefore;
+  result.allocsPerCall = -1;
+#endif
+  result.meanNs = totalNs / result.iterations;
+  result.p50Ns = computePercentile(benchmarkSamples, result.iterations, 50);
+  result.p90Ns = computePercentile(benchmarkSamples, result.iterations, 90);
+  result.maxNs = benchmarkSamples[result.iterations - 1];
+  return result;
+}
+
+/**
+ * Print one benchmark entry of the JSON report
+ */
+void printBenchmarkResult(const BenchmarkResult& result, bool last) {
+  Serial.printf("    {\"name\": \"%s\", \"iterations\": %u, \"time_unit\": \"ns\", "
+                "\"real_time\": %lu, \"p50\": %lu, \"p90\": %lu, \"max\": %lu, ",
+                result.name, result.iterations, (unsigned long)result.meanNs,
+                (unsigned long)result.p50Ns, (unsigned long)result.p90Ns, (unsigned long)result.maxNs);
+  if (result.allocsPerCall < 0) {
+    Serial.print("\"allocs_per_iteration\": null, ");
+  } else {
+    Serial.printf("\"allocs_per_iteration\": %.2f, ", result.allocsPerCall);
+  }
+  Serial.printf("\"retained_bytes\": %ld}%s\n", (long)result.retainedBytes, last ? "" : ",");
+}
+
+/**
+ * Run the whole suite and print the JSON report
+ */
+void runBenchmarks() {
+  const uint8_t NUM_BENCHMARKS = 8;
+  BenchmarkResult results[NUM_BENCHMARKS];
+  uint8_t count = 0;
+
+  Serial.println("Running benchmarks...");
+
+  // Scratch namespace and configuration, restored below
+  SystemConfig savedConfig = config;
+  prefs.end();
+  prefs.begin("benchmark", false);
+
+  // Five networks, as sent by the web interface
+  const char* networksBody =
+    "{\"networks\":["
+    "{\"ssid\":\"Network1\",\"password\":\"Password1\",\"enabled\":true},"
+    "{\"ssid\":\"Network2\",\"password\":\"Password2\",\"enabled\":true},"
+    "{\"ssid\":\"Network3\",\"password\":\"Password3\",\"enabled\":false},"
+    "{\"ssid\":\"Network4\",\"password\":\"Password4\",\"enabled\":true},"
+    "{\"ssid\":\"Network5\",\"password\":\"Password5\",\"enabled\":false}]}";
+
+  results[count++] = runBenchmark("handleGetStatus", BENCHMARK_ITERATIONS, []() {
+    String response;
+    buildStatusJson(response);
+  });
+
+  results[count++] = runBenchmark("handleSetNetworks/5", BENCHMARK_ITERATIONS, [networksBody]() {
+    parseNetworksJson(networksBody, strlen(networksBody));
+  });
+
+  results[count++] = runBenchmark("saveNetworksToPrefs/5", BENCHMARK_NVS_ITERATIONS, []() {
+    saveNetworksToPrefs();
+  });
+
+  results[count++] = runBenchmark("loadConfiguration", BENCHMARK_NVS_ITERATIONS, []() {
+    loadConfiguration();
+  });
+
+  prefs.clear();
+  prefs.end();
+  prefs.begin("esp32-config", false);
+  config = savedConfig;
+
+  DateTime dateTime(2024, 8, 16, 12, 30, 45);
+  results[count++] = runBenchmark("formatDateTime", BENCHMARK_ITERATIONS, [&dateTime]() {
+    char buffer[DATE_TIME_BUFFER_SIZE];
+    formatDateTime(dateTime, buffer, sizeof(buffer));
+  });
+
+  struct tm timeinfo = {};
+  timeinfo.tm_year = 124;
+  timeinfo.tm_mon = 7;
+  timeinfo.tm_mday = 16;
+  results[count++] = runBenchmark("formatTimeStruct", BENCHMARK_ITERATIONS, [&timeinfo]() {
+    char buffer[DATE_TIME_BUFFER_SIZE];
+    formatTimeStruct(timeinfo, buffer, sizeof(buffer));
+  });
+
+  // Steady state step: connected, only polls the link status
+  WiFiState savedState = currentWiFiState;
+  if (WiFi.status() == WL_CONNECTED) {
+    currentWiFiState = WIFI_CONNECTED;
+    results[count++] = runBenchmark("handleWiFiStateMachine/connected", BENCHMARK_ITERATIONS, []() {
+      handleWiFiStateMachine();
+    });
+  }
+
+  // Waiting step: only compares timestamps
+  currentWiFiState = WIFI_RECONNECTING;
+  lastConnectionAttempt = millis();
+  results[count++] = runBenchmark("handleWiFiStateMachine/waiting", BENCHMARK_ITERATIONS, []() {
+    handleWiFiStateMachine();
+  });
+  currentWiFiState = savedState;
+
+  // Print the report
+  Serial.println("BENCHMARK_BEGIN");
+  Serial.println("{");
+  Serial.println("  \"context\": {");
+  Serial.printf("    \"cpu_mhz\": %lu,\n", (unsigned long)ESP.getCpuFreqMHz());
+  Serial.printf("    \"free_heap\": %lu,\n", (unsigned long)ESP.getFreeHeap());
+#ifdef CONFIG_HEAP_USE_HOOKS
+  Serial.println("    \"heap_hooks\": true");
+#else
+  Serial.println("    \"heap_hooks\": false");
+#endif
+  Serial.println("  },");
+  Serial.println("  \"benchmarks\": [");
+  for (uint8_t i = 0; i < count; i++) {
+    printBenchmarkResult(results[i], i == count - 1);
+  }
+  Serial.println("  ]");
+  Serial.println("}");
+  Serial.println("BENCHMARK_END");
+}
+
+#endif // ENABLE_BENCHMARKS
+
+#endif // BENCHMARK_H
@@ -0,0 +1,224 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+/*
+ * Board description
+ *
+ * Every GPIO the firmware uses is declared once, with its role, its state
+ * during deep sleep and whether it can wake the chip. The sleep-entry pin
+ * masks are computed from this table at compile time (SleepPinMasks) and
+ * applied with a few gpio_config() calls, see applySleepPinConfiguration().
+ *
+ * A different board is another struct with the same members, selected by
+ * the Board alias below. Invalid tables (wake on a non RTC pin, pulls on an
+ * input-only pin, a pin listed twice) fail to compile.
+ */
+
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+
+/**
+ * What a GPIO is used for
+ */
+enum PinRole : uint8_t {
+  PIN_ROLE_RESERVED,      // Used by the system (UART0), never touched
+  PIN_ROLE_LED,
+  PIN_ROLE_BUTTON,
+  PIN_ROLE_DOOR_SENSOR,
+  PIN_ROLE_ACTUATOR_PWM,
+  PIN_ROLE_ACTUATOR_POWER,
+  PIN_ROLE_ANALOG,        // ADC input
+  PIN_ROLE_I2C,
+  PIN_ROLE_UNUSED         // Listed only to override the default sleep state
+};
+
+/**
+ * Pin state during deep sleep
+ */
+enum PinSleepState : uint8_t {
+  PIN_SLEEP_KEEP,         // Left as configured (driven externally, or a wake source)
+  PIN_SLEEP_PULLUP,       // Input with pull-up
+  PIN_SLEEP_PULLDOWN,     // Input with pull-down, keeps loads off
+  PIN_SLEEP_FLOATING,     // Input without pulls
+  PIN_SLEEP_ISOLATE       // Disconnected with rtc_gpio_isolate(), RTC pins only
+};
+
+/**
+ * Level that wakes the chip from deep sleep
+ */
+enum PinWake : uint8_t {
+  PIN_WAKE_NONE,
+  PIN_WAKE_LOW,
+  PIN_WAKE_HIGH
+};
+
+struct PinConfig {
+  uint8_t gpio;
+  PinRole role;
+  PinSleepState sleep;
+  PinWake wake;
+};
+
+// ESP32 GPIO capabilities
+const uint64_t GPIO_VALID_MASK = ((1ULL << 40) - 1) &
+                                 ~((0x3FULL << 6) | (1ULL << 20) | (1ULL << 24) | (0xFULL << 28));  // Flash pins 6-11 excluded
+const uint64_t GPIO_INPUT_ONLY_MASK = 0x3FULL << 34;  // 34-39: no output, no pulls
+const uint64_t GPIO_RTC_MASK = (1ULL << 0) | (1ULL << 2) | (1ULL << 4) | (0xFULL << 12) |
+                               (0x7ULL << 25) | (0xFFULL << 32);  // Can wake from and be isolated in deep sleep
+
+/**
+ * ESP32 DevKit V1 wiring
+ */
+struct DevKitBoard {
+  static constexpr uint8_t LED_PIN = 2;
+  static constexpr uint8_t BUTTON_PIN = 0;              // BOOT button, active low
+  static constexpr uint8_t DOOR_OUTER_PIN = 32;
+  static constexpr uint8_t DOOR_INNER_PIN = 33;
+  static constexpr uint8_t ACTUATOR_PWM_PIN = 25;
+  static constexpr uint8_t ACTUATOR_POWER_PIN = 26;
+  static constexpr uint8_t ACTUATOR_CURRENT_PIN = 34;   // ADC1
+  static constexpr uint8_t BATTERY_PIN = 35;            // ADC1, battery through a 1:2 divider
+  static constexpr uint8_t I2C_SDA_PIN = 21;
+  static constexpr uint8_t I2C_SCL_PIN = 22;
+
+  // Pins not listed go to UNUSED_SLEEP_STATE (pull-up, or floating if input-only)
+  static constexpr PinConfig pins[] = {
+    {1,  PIN_ROLE_RESERVED,       PIN_SLEEP_KEEP,     PIN_WAKE_NONE},  // UART0 TX
+    {3,  PIN_ROLE_RESERVED,       PIN_SLEEP_KEEP,     PIN_WAKE_NONE},  // UART0 RX
+    {LED_PIN, PIN_ROLE_LED,       PIN_SLEEP_PULLDOWN, PIN_WAKE_NONE},
+    {BUTTON_PIN, PIN_ROLE_BUTTON, PIN_SLEEP_KEEP,     PIN_WAKE_LOW},
+    {DOOR_OUTER_PIN, PIN_ROLE_DOOR_SENSOR, PIN_SLEEP_KEEP, PIN_WAKE_HIGH},
+    {DOOR_INNER_PIN, PIN_ROLE_DOOR_SENSOR, PIN_SLEEP_KEEP, PIN_WAKE_HIGH},
+    {ACTUATOR_PWM_PIN, PIN_ROLE_ACTUATOR_PWM, PIN_SLEEP_PULLDOWN, PIN_WAKE_NONE},
+    {ACTUATOR_POWER_PIN, PIN_ROLE_ACTUATOR_POWER, PIN_SLEEP_PULLDOWN, PIN_WAKE_NONE},  // Servo supply off
+    {ACTUATOR_CURRENT_PIN, PIN_ROLE_ANALOG, PIN_SLEEP_ISOLATE, PIN_WAKE_NONE},
+    {BATTERY_PIN, PIN_ROLE_ANALOG,      PIN_SLEEP_ISOLATE,  PIN_WAKE_NONE},
+    {I2C_SDA_PIN, PIN_ROLE_I2C,         PIN_SLEEP_KEEP,     PIN_WAKE_NONE},  // External pull-ups
+    {I2C_SCL_PIN, PIN_ROLE_I2C,         PIN_SLEEP_KEEP,     PIN_WAKE_NONE},
+    {12, PIN_ROLE_UNUSED,         PIN_SLEEP_ISOLATE,  PIN_WAKE_NONE},  // Strapping pin, leaks through its pull-down
+  };
+  static constexpr PinSleepState UNUSED_SLEEP_STATE = PIN_SLEEP_PULLUP;
+};
+
+// Board the firmware is built for
+typedef DevKitBoard Board;
+
+/**
+ * Pin masks derived from a board table at compile time
+ * @tparam B Board description
+ */
+template <typename B>
+struct SleepPinMasks {
+  static constexpr size_t COUNT = sizeof(B::pins) / sizeof(B::pins[0]);
+
+  static constexpr uint64_t listed() {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < COUNT; i++) {
+      mask |= 1ULL << B::pins[i].gpio;
+    }
+    return mask;
+  }
+
+  static constexpr uint64_t withSleepState(PinSleepState state) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < COUNT; i++) {
+      if (B::pins[i].sleep == state) {
+        mask |= 1ULL << B::pins[i].gpio;
+      }
+    }
+    // Unlisted pins take the default state, pulls only exist on output capable pins
+    uint64_t unused = GPIO_VALID_MASK & ~listed();
+    if (state == B::UNUSED_SLEEP_STATE) {
+      mask |= unused & ~GPIO_INPUT_ONLY_MASK;
+    }
+    if (state == PIN_SLEEP_FLOATING) {
+      mask |= unused & GPIO_INPUT_ONLY_MASK;
+    }
+    return mask;
+  }
+
+  static constexpr uint64_t withWake(PinWake wake) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < COUNT; i++) {
+      if (B::pins[i].wake == wake) {
+        mask |= 1ULL << B::pins[i].gpio;
+      }
+    }
+    return mask;
+  }
+
+  static constexpr bool unique() {
+    for (size_t i = 0; i < COUNT; i++) {
+      for (size_t j = i + 1; j < COUNT; j++) {
+        if (B::pins[i].gpio == B::pins[j].gpio) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  static constexpr uint64_t PULLUP = withSleepState(PIN_SLEEP_PULLUP);
+  static constexpr uint64_t PULLDOWN = withSleepState(PIN_SLEEP_PULLDOWN);
+  static constexpr uint64_t FLOATING = withSleepState(PIN_SLEEP_FLOATING);
+  static constexpr uint64_t ISOLATE = withSleepState(PIN_SLEEP_ISOLATE);
+  static constexpr uint64_t WAKE_LOW = withWake(PIN_WAKE_LOW);
+  static constexpr uint64_t WAKE_HIGH = withWake(PIN_WAKE_HIGH);
+
+  static_assert(unique(), "A GPIO is listed twice in the board table");
+  static_assert((listed() & ~GPIO_VALID_MASK) == 0, "Board table uses a pin that is not a GPIO");
+  static_assert(((PULLUP | PULLDOWN) & GPIO_INPUT_ONLY_MASK) == 0, "GPIO 34-39 have no pulls");
+  static_assert((ISOLATE & ~GPIO_RTC_MASK) == 0, "Only RTC GPIOs can be isolated");
+  static_assert(((WAKE_LOW | WAKE_HIGH) & ~GPIO_RTC_MASK) == 0, "Only RTC GPIOs can wake from deep sleep");
+};
+
+/**
+ * Put the pins in their deep sleep state
+ * One gpio_config() per pull setting, plus rtc_gpio_isolate() on the
+ * isolated pins
+ * @tparam B Board description
+ */
+template <typename B>
+void applySleepPinConfiguration() {
+  typedef SleepPinMasks<B> Masks;
+  gpio_config_t io = {};
+  io.mode = GPIO_MODE_INPUT;
+  io.intr_type = GPIO_INTR_DISABLE;
+
+  if (Masks::PULLUP) {
+    io.pin_bit_mask = Masks::PULLUP;
+    io.pull_up_en = GPIO_PULLUP_ENABLE;
+    io.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpio_config(&io);
+  }
+  if (Masks::PULLDOWN) {
+    io.pin_bit_mask = Masks::PULLDOWN;
+    io.pull_up_en = GPIO_PULLUP_DISABLE;
+    io.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    gpio_config(&io);
+  }
+  if (Masks::FLOATING) {
+    io.pin_bit_mask = Masks::FLOATING;
+    io.pull_up_en = GPIO_PULLUP_DISABLE;
+    io.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpio_config(&io);
+  }
+
+  for (uint64_t mask = Masks::ISOLATE; mask != 0; mask &= mask - 1) {
+    rtc_gpio_isolate((gpio_num_t)__builtin_ctzll(mask));
+  }
+}
+
+/**
+ * Release the pins isolated for deep sleep
+ * rtc_gpio_isolate() latches the pad with a hold that survives the wake
+ * @tparam B Board description
+ */
+template <typename B>
+void releaseSleepPinConfiguration() {
+  for (uint64_t mask = SleepPinMasks<B>::ISOLATE; mask != 0; mask &= mask - 1) {
+    rtc_gpio_hold_dis((gpio_num_t)__builtin_ctzll(mask));
+  }
+}
+
+#endif // BOARD_H
@@ -0,0 +1,35 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+ * System configuration
+ *
+ * The configuration edited through the web interface and saved in NVS.
+ * It is kept apart from the web server so that the modules using it at
+ * run time (WiFi connection, schedule) do not depend on the server.
+ */
+
+#include <type_traits>
+#include "types.h"
+
+// Configuration constants
+const uint8_t MAX_NETWORKS = 5;  // WiFi networks stored in the configuration
+
+/**
+ * Main system configuration structure
+ * Contains scheduled action time and WiFi networks array
+ * Plain data only: it can be copied with memcpy() to NVS or RTC memory
+ */
+struct SystemConfig {
+  uint8_t actionHour;                 // Hour for scheduled action (0-23)
+  uint8_t actionMinute;               // Minute for scheduled action (0-59)
+  WiFiNetwork networks[MAX_NETWORKS]; // Array of up to MAX_NETWORKS WiFi networks
+  uint8_t networkCount;               // Number of configured networks
+};
+
+static_assert(std::is_trivially_copyable<SystemConfig>::value, "SystemConfig must stay plain data");
+
+// Global configuration instance
+SystemConfig config;
+
+#endif // CONFIG_H
@@ -0,0 +1,319 @@
+#ifndef DOOR_SENSOR_H
+#define DOOR_SENSOR_H
+
+/*
+ * Door passage detector
+ *
+ * Two IR-beam (or hall) sensors are mounted on the outer and inner side of
+ * the flap. GPIO interrupts only timestamp the edges and push them into a
+ * lock-free single-producer/single-consumer ring buffer. handleDoorSensors()
+ * drains the buffer from loop(), filters bounces and runs a small state
+ * machine that infers the direction of each passage:
+ *
+ *   outer activates first, inner released last  -> EVENT_DOOR_ENTRY
+ *   inner activates first, outer released last  -> EVENT_DOOR_EXIT
+ *   same sensor first and last (cat turned back) -> EVENT_DOOR_REJECTED
+ */
+
+#include <atomic>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
+#include "board.h"
+#include "events.h"
+#include "rtc.h"
+#include "lifetime.h"
+
+// Sensor indexes
+enum DoorSensor : uint8_t {
+  DOOR_SENSOR_OUTER = 0,
+  DOOR_SENSOR_INNER = 1,
+  DOOR_SENSOR_COUNT = 2
+};
+
+// Configuration constants
+const uint8_t DOOR_SENSOR_OUTER_PIN = Board::DOOR_OUTER_PIN;         // RTC capable GPIO, usable as wake source
+const uint8_t DOOR_SENSOR_INNER_PIN = Board::DOOR_INNER_PIN;         // RTC capable GPIO, usable as wake source
+const uint8_t DOOR_SENSOR_ACTIVE_LEVEL = HIGH;      // Level when the beam is broken
+const uint32_t DOOR_DEBOUNCE_US = 2000;             // Edges reverted within 2 ms are bounces
+const uint32_t DOOR_CLEAR_US = 300000;              // Both sensors clear for 300 ms ends a passage
+const uint32_t DOOR_PASSAGE_TIMEOUT_US = 5000000;   // Passages longer than 5 s are discarded
+const uint32_t DOOR_EDGE_BUFFER_SIZE = 32;          // Must be a power of two
+
+// Pin table, kept in DRAM because it is read from the interrupt handler
+DRAM_ATTR const uint8_t doorSensorPins[DOOR_SENSOR_COUNT] = {
+  DOOR_SENSOR_OUTER_PIN,
+  DOOR_SENSOR_INNER_PIN
+};
+
+/**
+ * Raw edge captured by the interrupt handler
+ */
+struct DoorEdge {
+  uint32_t timestamp;  // esp_timer time in microseconds
+  uint8_t sensor;      // DoorSensor index
+  uint8_t level;       // Pin level read in the interrupt
+};
+
+// Edge ring buffer (producer: ISR, consumer: loop)
+DoorEdge doorEdges[DOOR_EDGE_BUFFER_SIZE];
+std::atomic<uint32_t> doorEdgeHead(0);
+std::atomic<uint32_t> doorEdgeTail(0);
+volatile uint32_t doorEdgeOverruns = 0;
+
+// Debounced sensor state
+bool doorSensorActive[DOOR_SENSOR_COUNT] = {false, false};
+bool doorEdgePending[DOOR_SENSOR_COUNT] = {false, false};
+uint32_t doorEdgePendingTime[DOOR_SENSOR_COUNT] = {0, 0};
+uint32_t lastDoorEdgeOverruns = 0;
+
+// Passage state machine
+bool doorPassageActive = false;
+bool doorPassageClearing = false;
+uint8_t doorPassageOrigin = DOOR_SENSOR_OUTER;
+uint8_t doorPassageSeen = 0;          // Bit mask of sensors activated during the passage
+uint8_t doorPassageLastReleased = DOOR_SENSOR_OUTER;
+uint32_t doorPassageStart = 0;
+uint32_t doorPassageClearTime = 0;
+
+void initializeDoorSensors();
+void publishDoorEdge(uint8_t sensor, uint32_t timestamp, uint8_t level);
+void onDoorSensorWake(uint8_t gpio);
+void handleDoorSensors();
+void processDoorEdge(const DoorEdge& edge);
+void commitDueDoorEdges(uint32_t now);
+void onDoorSensorChange(uint8_t sensor, bool active, uint32_t timestamp);
+void finishDoorPassage(uint32_t timestamp);
+void resetDoorPassage();
+
+/**
+ * GPIO interrupt handler, shared by both sensors
+ * Only timestamps the edge and publishes it to the ring buffer
+ * @param arg DoorSensor index of the pin that fired
+ */
+void IRAM_ATTR onDoorSensorEdge(void* arg) {
+  uint32_t timestamp = (uint32_t)esp_timer_get_time();
+  uint8_t sensor = (uint8_t)(uintptr_t)arg;
+  publishDoorEdge(sensor, timestamp, gpio_ll_get_level(&GPIO, doorSensorPins[sensor]));
+}
+
+/**
+ * Push an edge into the ring buffer
+ * The ring has a single producer: outside the interrupt handler, call it
+ * only with the door sensor interrupts disabled
+ * @param sensor DoorSensor index
+ * @param timestamp esp_timer time in microseconds
+ * @param level Pin level after the edge
+ */
+void IRAM_ATTR publishDoorEdge(uint8_t sensor, uint32_t timestamp, uint8_t level) {
+  uint32_t head = doorEdgeHead.load(std::memory_order_relaxed);
+
+  if (head - doorEdgeTail.load(std::memory_order_acquire) >= DOOR_EDGE_BUFFER_SIZE) {
+    doorEdgeOverruns++;
+    return;
+  }
+
+  DoorEdge& edge = doorEdges[head & (DOOR_EDGE_BUFFER_SIZE - 1)];
+  edge.timestamp = timestamp;
+  edge.sensor = sensor;
+  edge.level = level;
+  doorEdgeHead.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Configure sensor pins and attach the edge interrupts
+ */
+void initializeDoorSensors() {
+  static bool initialized = false;
+  if (initialized) {
+    return;  // Already done by the wake dispatch
+  }
+  initialized = true;
+
+  Serial.println("Initializing door sensors...");
+
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    pinMode(doorSensorPins[i], INPUT);
+    doorSensorActive[i] = (digitalRead(doorSensorPins[i]) == DOOR_SENSOR_ACTIVE_LEVEL);
+    attachInterruptArg(doorSensorPins[i], onDoorSensorEdge, (void*)(uintptr_t)i, CHANGE);
+  }
+
+  Serial.print("Door sensors on GPIO");
+  Serial.print(DOOR_SENSOR_OUTER_PIN);
+  Serial.print(" (outer) and GPIO");
+  Serial.print(DOOR_SENSOR_INNER_PIN);
+  Serial.println(" (inner)");
+}
+
+/**
+ * A door sensor woke the chip from deep sleep (EXT1)
+ * Called by the wake dispatch before the rest of setup(): the beam was
+ * broken while asleep, so the edge that started the passage is published
+ * now, stamped 0 since esp_timer only started at boot. A short passage may
+ * already be over: its release is published too, kept further than the
+ * debounce time from the start so the pair is not taken for a bounce.
+ * @param gpio Pin reported by the EXT1 wake status
+ */
+void onDoorSensorWake(uint8_t gpio) {
+  initializeDoorSensors();
+
+  // Single producer: the handler must not publish meanwhile
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    gpio_intr_disable((gpio_num_t)doorSensorPins[i]);
+  }
+
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    if (doorSensorPins[i] == gpio) {
+      doorSensorActive[i] = false;
+      publishDoorEdge(i, 0, DOOR_SENSOR_ACTIVE_LEVEL);
+      if (gpio_get_level((gpio_num_t)gpio) != DOOR_SENSOR_ACTIVE_LEVEL) {
+        publishDoorEdge(i, max(now, DOOR_DEBOUNCE_US), !DOOR_SENSOR_ACTIVE_LEVEL);
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    gpio_intr_enable((gpio_num_t)doorSensorPins[i]);
+  }
+}
+
+/**
+ * Drain captured edges and advance the passage state machine
+ * Called on every loop() iteration, never blocks
+ */
+void handleDoorSensors() {
+  // Edges were lost: the sequence can't be trusted, resynchronize
+  if (doorEdgeOverruns != lastDoorEdgeOverruns) {
+    lastDoorEdgeOverruns = doorEdgeOverruns;
+    Serial.println("⚠ Door sensor edge buffer overrun");
+    doorEdgeTail.store(doorEdgeHead.load(std::memory_order_acquire), std::memory_order_release);
+    for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+      doorSensorActive[i] = (digitalRead(doorSensorPins[i]) == DOOR_SENSOR_ACTIVE_LEVEL);
+      doorEdgePending[i] = false;
+    }
+    resetDoorPassage();
+    return;
+  }
+
+  uint32_t tail = doorEdgeTail.load(std::memory_order_relaxed);
+  uint32_t head = doorEdgeHead.load(std::memory_order_acquire);
+  while (tail != head) {
+    DoorEdge edge = doorEdges[tail & (DOOR_EDGE_BUFFER_SIZE - 1)];
+    tail++;
+    doorEdgeTail.store(tail, std::memory_order_release);
+    processDoorEdge(edge);
+  }
+
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  commitDueDoorEdges(now);
+
+  // End of passage: both sensors stayed clear long enough
+  if (doorPassageClearing && now - doorPassageClearTime >= DOOR_CLEAR_US) {
+    finishDoorPassage(doorPassageClearTime);
+  }
+
+  // Sensor blocked or sequence incomplete for too long
+  if (doorPassageActive && !doorPassageClearing && now - doorPassageStart >= DOOR_PASSAGE_TIMEOUT_US) {
+    postEvent(EVENT_DOOR_REJECTED, currentUnixTime(), 0, -1);
+    resetDoorPassage();
+  }
+}
+
+/**
+ * Debounce a raw edge
+ * An edge becomes a state change only if it is not reverted within
+ * DOOR_DEBOUNCE_US, the change keeps the timestamp of the original edge
+ */
+void processDoorEdge(const DoorEdge& edge) {
+  commitDueDoorEdges(edge.timestamp);
+
+  uint8_t sensor = edge.sensor;
+  bool active = (edge.level == DOOR_SENSOR_ACTIVE_LEVEL);
+
+  if (doorEdgePending[sensor]) {
+    // Reverted before the debounce time elapsed: bounce
+    if (active == doorSensorActive[sensor]) {
+      doorEdgePending[sensor] = false;
+    }
+  } else if (active != doorSensorActive[sensor]) {
+    doorEdgePending[sensor] = true;
+    doorEdgePendingTime[sensor] = edge.timestamp;
+  }
+}
+
+/**
+ * Commit pending edges older than the debounce time, oldest first
+ */
+void commitDueDoorEdges(uint32_t now) {
+  while (true) {
+    int8_t oldest = -1;
+    for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+      if (doorEdgePending[i] && now - doorEdgePendingTime[i] >= DOOR_DEBOUNCE_US &&
+          (oldest < 0 || (int32_t)(doorEdgePendingTime[i] - doorEdgePendingTime[oldest]) < 0)) {
+        oldest = i;
+      }
+    }
+    if (oldest < 0) {
+      return;
+    }
+
+    doorEdgePending[oldest] = false;
+    doorSensorActive[oldest] = !doorSensorActive[oldest];
+    onDoorSensorChange(oldest, doorSensorActive[oldest], doorEdgePendingTime[oldest]);
+  }
+}
+
+/**
+ * Passage state machine, fed with debounced state changes
+ */
+void onDoorSensorChange(uint8_t sensor, bool active, uint32_t timestamp) {
+  if (active) {
+    if (!doorPassageActive) {
+      doorPassageActive = true;
+      doorPassageOrigin = sensor;
+      doorPassageSeen = 0;
+      doorPassageStart = timestamp;
+    }
+    doorPassageSeen |= (1 << sensor);
+    doorPassageClearing = false;
+    return;
+  }
+
+  if (!doorPassageActive) {
+    return;  // Release of a passage that already timed out
+  }
+
+  doorPassageLastReleased = sensor;
+  if (!doorSensorActive[DOOR_SENSOR_OUTER] && !doorSensorActive[DOOR_SENSOR_INNER]) {
+    // Wait a little: the other sensor may still be reached
+    doorPassageClearing = true;
+    doorPassageClearTime = timestamp;
+  }
+}
+
+/**
+ * Classify a completed sequence and emit the matching event
+ */
+void finishDoorPassage(uint32_t timestamp) {
+  int16_t durationMs = (int16_t)min((timestamp - doorPassageStart) / 1000, (uint32_t)INT16_MAX);
+
+  if (doorPassageSeen == 0x03 && doorPassageOrigin != doorPassageLastReleased) {
+    EventType type = (doorPassageOrigin == DOOR_SENSOR_OUTER) ? EVENT_DOOR_ENTRY : EVENT_DOOR_EXIT;
+    postEvent(type, currentUnixTime(), 0, durationMs);
+    lifetimeIncrement(LIFETIME_DOOR_PASSAGES);
+  } else {
+    // Half passage: the cat looked through the flap and turned back
+    postEvent(EVENT_DOOR_REJECTED, currentUnixTime(), 0, durationMs);
+  }
+
+  resetDoorPassage();
+}
+
+void resetDoorPassage() {
+  doorPassageActive = false;
+  doorPassageClearing = false;
+  doorPassageSeen = 0;
+}
+
+#endif // DOOR_SENSOR_H
@@ -0,0 +1,197 @@
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+/*
+ * Activity-adaptive duty cycle
+ *
+ * The time between the end of a wake and the next one depends on recent
+ * activity, tracked in RTC memory across deep sleep:
+ * - BURST: after a door passage, a button wake or a web request the board
+ *   stays up and only naps in light sleep between loop() passes, waking
+ *   instantly on a door sensor edge
+ * - NORMAL: the usual deep sleep cycle
+ * - DEEP_IDLE: at night (local time), once nothing has happened for a
+ *   while, deep sleep with a longer timer period
+ *
+ * Hysteresis: any activity switches to BURST at once, BURST falls back to
+ * NORMAL only after DUTY_BURST_HOLD_S without activity, DEEP_IDLE is only
+ * entered after DUTY_DEEP_IDLE_QUIET_S without activity and left on
+ * activity or at the end of the night.
+ */
+
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include "metrics.h"
+#include "door_sensor.h"
+#include "actuator.h"
+#include "rtc.h"
+
+// Configuration constants
+const uint32_t DUTY_BURST_HOLD_S = 300;          // Stay in burst 5 minutes after the last activity
+const uint32_t DUTY_DEEP_IDLE_QUIET_S = 1800;    // 30 quiet minutes before deep idle
+const uint8_t DUTY_NIGHT_START_HOUR = 22;        // Cats locked in from 22:00...
+const uint8_t DUTY_NIGHT_END_HOUR = 6;           // ...to 06:00 (local time)
+const uint64_t DUTY_NORMAL_SLEEP_US = 60000000;     // 1 minute
+const uint64_t DUTY_DEEP_IDLE_SLEEP_US = 300000000; // 5 minutes
+const uint64_t DUTY_BURST_NAP_US = 250000;       // Light sleep between loop() passes
+
+enum DutyCycleMode : uint8_t {
+  DUTY_NORMAL,
+  DUTY_BURST,
+  DUTY_DEEP_IDLE
+};
+
+/**
+ * Activity state kept across deep sleep
+ */
+struct DutyCycleState {
+  DutyCycleMode mode;
+  uint32_t lastActivity;     // Unix time of the last activity, 0 if none
+  uint32_t activityCount;    // Activities since the last mode change
+};
+
+// Global variables
+RTC_DATA_ATTR DutyCycleState dutyCycle = {DUTY_NORMAL, 0, 0};
+uint32_t dutyCycleHttpRequests = 0;  // Last seen value of the HTTP request counter
+
+const char* getDutyCycleModeString(DutyCycleMode mode) {
+  switch (mode) {
+    case DUTY_NORMAL: return "NORMAL";
+    case DUTY_BURST: return "BURST";
+    case DUTY_DEEP_IDLE: return "DEEP_IDLE";
+    default: return "UNKNOWN";
+  }
+}
+
+void setDutyCycleMode(DutyCycleMode mode) {
+  if (mode == dutyCycle.mode) {
+    return;
+  }
+  Serial.print("Duty cycle: ");
+  Serial.print(getDutyCycleModeString(dutyCycle.mode));
+  Serial.print(" -> ");
+  Serial.print(getDutyCycleModeString(mode));
+  Serial.print(" (");
+  Serial.print(dutyCycle.activityCount);
+  Serial.println(" activities)");
+
+  dutyCycle.mode = mode;
+  dutyCycle.activityCount = 0;
+}
+
+/**
+ * Record an activity: door passage, button wake, web request
+ * @param now Current Unix time, 0 if unknown
+ */
+void dutyCycleActivity(uint32_t now) {
+  dutyCycle.activityCount++;
+  if (now != 0) {
+    dutyCycle.lastActivity = now;
+  }
+  setDutyCycleMode(DUTY_BURST);
+}
+
+bool isNightTime(uint32_t now) {
+  struct tm local;
+  localTimeOf(now, local);
+  return local.tm_hour >= DUTY_NIGHT_START_HOUR || local.tm_hour < DUTY_NIGHT_END_HOUR;
+}
+
+/**
+ * Re-evaluate the mode, called from loop() before deciding how to sleep
+ * @param now Current Unix time, 0 if unknown (the mode then falls back to NORMAL)
+ */
+void updateDutyCycle(uint32_t now) {
+  // Web sessions count as activity
+  uint32_t httpRequests = metricCounters[COUNTER_HTTP_REQUESTS].load(std::memory_order_relaxed);
+  if (httpRequests != dutyCycleHttpRequests) {
+    dutyCycleHttpRequests = httpRequests;
+    dutyCycleActivity(now);
+  }
+
+  if (now == 0) {
+    if (dutyCycle.mode == DUTY_DEEP_IDLE) {
+      setDutyCycleMode(DUTY_NORMAL);
+    }
+    return;
+  }
+
+  uint32_t quiet = (dutyCycle.lastActivity != 0 && now > dutyCycle.lastActivity)
+                     ? now - dutyCycle.lastActivity : UINT32_MAX;
+  if (dutyCycle.lastActivity > now) {
+    quiet = 0;  // RTC set backwards, restart counting
+    dutyCycle.lastActivity = now;
+  }
+
+  switch (dutyCycle.mode) {
+    case DUTY_BURST:
+      if (quiet >= DUTY_BURST_HOLD_S) {
+        setDutyCycleMode(DUTY_NORMAL);
+      }
+      break;
+
+    case DUTY_NORMAL:
+      if (isNightTime(now) && quiet >= DUTY_DEEP_IDLE_QUIET_S) {
+        setDutyCycleMode(DUTY_DEEP_IDLE);
+      }
+      break;
+
+    case DUTY_DEEP_IDLE:
+      if (!isNightTime(now)) {
+        setDutyCycleMode(DUTY_NORMAL);
+      }
+      break;
+  }
+}
+
+/**
+ * Deep sleep timer period for the current mode
+ */
+uint64_t dutyCycleSleepTime() {
+  return (dutyCycle.mode == DUTY_DEEP_IDLE) ? DUTY_DEEP_IDLE_SLEEP_US : DUTY_NORMAL_SLEEP_US;
+}
+
+/**
+ * Short light sleep used in burst mode
+ * RAM, peripherals and the loop() state are kept. The nap ends on the timer
+ * or at once on any door sensor edge. Skipped while the actuator is driven
+ * (its PWM stops in light sleep). The caller must not nap during a WiFi
+ * station session: esp_light_sleep_start() drops the association, and one
+ * in progress would fail.
+ */
+void dutyCycleNap() {
+  if (isActuatorBusy()) {
+    return;
+  }
+
+  // GPIO wakeup needs a level trigger: the edge interrupts are suspended and
+  // each pin wakes on the level opposite to the current one, i.e. on its next edge
+  int levels[DOOR_SENSOR_COUNT];
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    gpio_num_t pin = (gpio_num_t)doorSensorPins[i];
+    levels[i] = gpio_get_level(pin);
+    gpio_intr_disable(pin);
+    gpio_wakeup_enable(pin, levels[i] ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(DUTY_BURST_NAP_US);
+
+  Serial.flush();
+  esp_light_sleep_start();
+
+  // Publish the edges that woke us while every interrupt is still off: the
+  // door sensor ring has a single producer, the ISR must not run meanwhile
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    gpio_num_t pin = (gpio_num_t)doorSensorPins[i];
+    gpio_wakeup_disable(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    if (gpio_get_level(pin) != levels[i]) {
+      onDoorSensorEdge((void*)(uintptr_t)i);
+    }
+  }
+  for (uint8_t i = 0; i < DOOR_SENSOR_COUNT; i++) {
+    gpio_intr_enable((gpio_num_t)doorSensorPins[i]);
+  }
+}
+
+#endif // DUTY_CYCLE_H
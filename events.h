@@ -0,0 +1,120 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+/*
+ * Event system
+ *
+ * Input subsystems (door sensors, buttons, telemetry) post events into a small
+ * ring queue. The main loop drains the queue and dispatches each event to
+ * the interested modules. The queue is only used from loop() context,
+ * interrupt handlers must use their own buffers (see door_sensor.h).
+ */
+
+/**
+ * Types of events produced by the input subsystems
+ */
+enum EventType : uint8_t {
+  EVENT_NONE = 0,
+  EVENT_DOOR_ENTRY,     // Passage from outside to inside
+  EVENT_DOOR_EXIT,      // Passage from inside to outside
+  EVENT_DOOR_REJECTED,  // Sensor sequence rejected (half passage or timeout)
+  EVENT_TEMPERATURE,    // Telemetry: DS3231 temperature in 0.25 °C
+  EVENT_BATTERY,        // Telemetry: battery voltage in mV
+  EVENT_WIFI_RSSI,      // Telemetry: WiFi RSSI in dBm
+  EVENT_WAKE_DURATION,  // Telemetry: duration of a wake in 10 ms
+  EVENT_TYPE_COUNT      // Number of types, keep last
+};
+
+/**
+ * Single event record
+ */
+struct Event {
+  uint32_t timestamp;  // Unix time in seconds (0 if RTC time is not valid)
+  EventType type;      // What happened
+  uint8_t subject;     // Cat identifier (0 = unknown)
+  int16_t value;       // Type specific payload (e.g. passage duration in ms)
+};
+
+// Configuration constants
+const uint8_t EVENT_QUEUE_SIZE = 16;  // Must be a power of two
+
+// Global variables
+Event eventQueue[EVENT_QUEUE_SIZE];
+uint8_t eventQueueHead = 0;
+uint8_t eventQueueTail = 0;
+uint32_t droppedEvents = 0;
+
+/**
+ * Add an event to the queue
+ * @param type Event type
+ * @param timestamp Unix time of the event
+ * @param subject Cat identifier (0 = unknown)
+ * @param value Type specific payload
+ * @return false if the queue is full and the event was dropped
+ */
+bool postEvent(EventType type, uint32_t timestamp, uint8_t subject, int16_t value) {
+  uint8_t next = (eventQueueHead + 1) & (EVENT_QUEUE_SIZE - 1);
+  if (next == eventQueueTail) {
+    droppedEvents++;
+    return false;
+  }
+
+  Event& event = eventQueue[eventQueueHead];
+  event.timestamp = timestamp;
+  event.type = type;
+  event.subject = subject;
+  event.value = value;
+  eventQueueHead = next;
+  return true;
+}
+
+/**
+ * Take the oldest event from the queue
+ * @param event Destination for the event
+ * @return false if the queue is empty
+ */
+bool pollEvent(Event& event) {
+  if (eventQueueTail == eventQueueHead) {
+    return false;
+  }
+
+  event = eventQueue[eventQueueTail];
+  eventQueueTail = (eventQueueTail + 1) & (EVENT_QUEUE_SIZE - 1);
+  return true;
+}
+
+// Utility functions
+const char* getEventTypeString(EventType type) {
+  switch (type) {
+    case EVENT_DOOR_ENTRY: return "DOOR_ENTRY";
+    case EVENT_DOOR_EXIT: return "DOOR_EXIT";
+    case EVENT_DOOR_REJECTED: return "DOOR_REJECTED";
+    case EVENT_TEMPERATURE: return "TEMPERATURE";
+    case EVENT_BATTERY: return "BATTERY";
+    case EVENT_WIFI_RSSI: return "WIFI_RSSI";
+    case EVENT_WAKE_DURATION: return "WAKE_DURATION";
+    default: return "NONE";
+  }
+}
+
+/**
+ * Whether a type is a telemetry record (compacted samples, see telemetry.h)
+ */
+inline bool isTelemetryEventType(EventType type) {
+  return type >= EVENT_TEMPERATURE && type <= EVENT_WAKE_DURATION;
+}
+
+/**
+ * Event type from its name, as returned by getEventTypeString()
+ * @return EVENT_NONE if the name is unknown
+ */
+EventType getEventTypeFromString(const char* name) {
+  for (uint8_t type = EVENT_NONE + 1; type < EVENT_TYPE_COUNT; type++) {
+    if (strcmp(name, getEventTypeString((EventType)type)) == 0) {
+      return (EventType)type;
+    }
+  }
+  return EVENT_NONE;
+}
+
+#endif // EVENTS_H
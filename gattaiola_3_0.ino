@@ -1,9 +1,25 @@
+// Uncomment to run the benchmark suite at boot (JSON report on serial)
+// #define ENABLE_BENCHMARKS
+
+// Uncomment to record trace zones (dump with 't' on serial or GET /api/trace)
+// #define ENABLE_TRACING
+
+#include "board.h"
 #include "rtc.h"
 #include "utilities.h"
 #include "sleep.h"
 #include "wifi.h"
 #include <cstdint>
 #include "web_server.h"
+#include "events.h"
+#include "door_sensor.h"
+#include "wake_dispatch.h"
+#include "duty_cycle.h"
+#include "snapshot.h"
+#include "status_led.h"
+#include "battery.h"
+#include "benchmark.h"
+#include "telemetry.h"
 
 // Configuration constants
 const uint32_t mS_TO_S_FACTOR = 1000;  // Conversion factor for milliseconds to seconds
@@ -11,15 +27,8 @@ const uint64_t uS_TO_S_FACTOR = 1000000;  // Conversion factor for microseconds
 
 const uint32_t ONE_SECOND = 1 * mS_TO_S_FACTOR;
 const uint32_t UP_TIME = 30 * mS_TO_S_FACTOR;
-const uint64_t SLEEP_TIME_1_MIN = 60 * uS_TO_S_FACTOR;
-
-const uint8_t BOOT_BUTTON_PIN = 0;  // GPIO0 (usually the BOOT button)
-
-const uint32_t LED_BUILTIN = 2;  // Most ESP32 boards have builtin LED on GPIO2
 
-// Timing variables
-unsigned long previousMillis = 0;
-const unsigned long BLINK_INTERVAL = 250;  // 250ms = 2Hz (ON 250ms, OFF 250ms)
+const uint8_t BOOT_BUTTON_PIN = Board::BUTTON_PIN;  // GPIO0 (usually the BOOT button)
 
 // Flag to indicate RTC error status
 bool rtcError = true;
@@ -27,53 +36,117 @@ bool rtcError = true;
 // Flag to indicate access point mode status
 bool accessPointMode = false;
 
-// LED state
-bool ledState = false;
-
 void setup() {
   Serial.begin(115200);
-  delay(100);
+
+  // Door and button wakes go to their handler before anything else
+  dispatchWake(esp_sleep_get_wakeup_cause());
+
+  // Local time zone for the night window, scheduled action and daily stats
+  initializeTimezone();
   
   Serial.println("\n=== ESP32 WiFi + NTP + RTC DS3231 Sync ===");
 
-  // Initialize builtin LED pin
-  pinMode(LED_BUILTIN, OUTPUT);
-  digitalWrite(LED_BUILTIN, LOW);  // Start with LED OFF
+  // Get wake up reason and restore the counters kept across deep sleep
+  esp_sleep_wakeup_cause_t wakeup_reason = getWakeupReason();
+  initializeMetrics(wakeup_reason);
+  uint32_t skippedWakes = takeWakeStubSkippedWakes();
+  metricIncrement(COUNTER_WAKE_STUB_SKIPPED, skippedWakes);
+
+  // Count this boot (and the wakes absorbed by the stub), RTC memory only
+  initializeLifetimeCounters(wakeup_reason);
+  lifetimeIncrement(LIFETIME_WAKES_TIMER, skippedWakes);
+
+  // Event journal index, rebuilt from flash on power-on
+  initializeJournal(wakeup_reason);
+  initializeStats(wakeup_reason);
+  initializeTelemetry(wakeup_reason);
+
+  // State of the previous wake cycle, rebuilt below if not available
+  bool snapshotRestored = restoreSnapshot(wakeup_reason);
+
+  // Status LED, driven by LEDC (starts OFF)
+  initializeStatusLed();
 
     // Set BOOT button (usually GPIO0) as input
   pinMode(BOOT_BUTTON_PIN, INPUT);
 
+  if (wakeup_reason == ESP_SLEEP_WAKEUP_UNDEFINED) {  // Boot after power reset
+    // Read BOOT button state
+    int bootButtonState = digitalRead(BOOT_BUTTON_PIN);
+    Serial.print("BOOT button state: ");
+    Serial.println(bootButtonState == HIGH ? "Released" : "Pressed");
+
+    // Enter access point mode
+    accessPointMode = (bootButtonState == LOW);
+    setLedStatus(LED_STATUS_AP_MODE, accessPointMode);
+  }
+
+  // Load the saved configuration from NVS, unless restored from the snapshot
+  // (the WiFi networks to connect to are part of it)
+  initializeConfiguration(!snapshotRestored);
+
+  // Kick off the radio early: association and DHCP run in the WiFi task
+  // while I2C and RTC validation happen below.
+  // The network is needed to fix the RTC time, which is unknown after a
+  // power reset or if it was invalid before sleep.
+  bool wifiStarted = false;
+  if (!accessPointMode && (!snapshotRestored || !rtcTimeValid)) {
+    startWiFiConnection();
+    wifiStarted = true;
+  }
+
+  // Start capturing door passages (already done on a door sensor wake)
+  initializeDoorSensors();
+
+  // Lock actuator stays unpowered until the first move
+  initializeActuator();
+
   // Initialize I2C and RTC
-  Wire.begin();
-  initializeRTC();
-  
-  // Check RTC time validity
-  rtcError != checkRTCTime();
+  initializeI2CBus();
+  if (snapshotRestored && rtcFound && refreshRTC()) {
+    // Validity known from the snapshot, unless the DS3231 lost power during
+    // the sleep: the burst read just fetched the status register too
+    if (rtcStatus & DS3231_STATUS_OSF) {
+      Serial.println("⚠ RTC lost power during sleep - time invalid");
+      rtcTimeValid = false;
+    }
+    rtcError = !rtcTimeValid;
+  } else {
+    initializeRTC();
 
-  // Get wake up reason
-  esp_sleep_wakeup_cause_t wakeup_reason = getWakeupReason();
-  switch (wakeup_reason) {
-    case ESP_SLEEP_WAKEUP_UNDEFINED:  // Boot after power reset
-      // Read BOOT button state
-      int bootButtonState = digitalRead(BOOT_BUTTON_PIN);
-      Serial.print("BOOT button state: ");
-      Serial.println(bootButtonState == HIGH ? "Released" : "Pressed");
-
-      if (bootButtonState == LOW) {
-        // Enter access point mode
-        accessPointMode = true;
-
-        // Initialize web server ---
-        webServerSetup();
-      }
-    break;
+    // Check RTC time validity
+    rtcError = !checkRTCTime();
+  }
+
+  // Measure the last sleep against the RTC
+  updateSleepCalibration(wakeup_reason, skippedWakes);
+
+  // Button wakes count as activity for the duty cycle (door wakes post an event)
+  if (wakeByButton) {
+    dutyCycleActivity(currentUnixTime());
   }
 
+  // RTC time is good: the speculative connection is not needed
+  if (wifiStarted && rtcTimeValid) {
+    stopWiFiConnection();
+    wifiStarted = false;
+  }
+
+  if (accessPointMode) {
+    // Initialize web server ---
+    webServerSetup();
+  }
+
+  // Check the battery, the ADC pins were isolated during sleep
+  releaseSleepPinConfiguration<Board>();
+  initializeBattery();
+  setLedStatus(LED_STATUS_LOW_BATTERY, batteryLow);
+
   // Blink built-in LED in case of error
+  setLedStatus(LED_STATUS_RTC_ERROR, rtcError);
   if (rtcError) {
-    handleLEDBlink();
-
-    if (!accessPointMode) {
+    if (!accessPointMode && !wifiStarted) {
       // Start the connection process
       startWiFiConnection();
     }
@@ -81,14 +154,44 @@ void setup() {
   
   // Display final status
   displayTimeStatus();
+
+#ifdef ENABLE_BENCHMARKS
+  runBenchmarks();
+#endif
 }
 
 void loop() {
-  // Handle LED blinking (non-blocking)
-  handleLEDBlink();
+  // Serial commands: 's' runs the self-test, 't' dumps the trace buffer
+  while (Serial.available()) {
+    char command = Serial.read();
+    handleSelfTestCommand(command);
+#ifdef ENABLE_TRACING
+    handleTraceCommand(command);
+#endif
+  }
+
+  // Detect door passages and dispatch the resulting events
+  handleDoorSensors();
+  handleEvents();
+
+  // Advance the lock actuator motion (non-blocking)
+  handleActuator();
 
   // Handle WiFi state machine (non-blocking)
-  //handleWiFiStateMachine();
+  handleWiFiStateMachine();
+  setLedStatus(LED_STATUS_WIFI_CONNECTING,
+               currentWiFiState != WIFI_STOPPED && currentWiFiState != WIFI_CONNECTED);
+
+  // Periodic battery check
+  handleBattery();
+  setLedStatus(LED_STATUS_LOW_BATTERY, batteryLow);
+
+  // Telemetry samples for the history charts
+  handleTelemetry();
+
+  // Save the lifetime counters now and then, at once when the battery is low
+  checkpointLifetimeCounters(batteryLow);
+  handleStats(batteryLow);
 
   // Periodic status check
   //handleStatusCheck();
@@ -104,23 +207,71 @@ void loop() {
     lastDisplay = millis();
   }
 
-  if ((millis() - upTime > UP_TIME) && (!rtcError)) {
-    // Enter deep sleep with multiple wake sources
-    enterDeepSleep(SLEEP_TIME_1_MIN, true, true);
+  // The access point stays up as long as the configuration session lasts
+  if ((millis() - upTime > UP_TIME) && (!rtcError) && (!accessPointMode)) {
+    updateDutyCycle(currentUnixTime());
+
+    if (dutyCycle.mode == DUTY_BURST) {
+      // Recent activity: stay up, napping until the next door edge
+      // (neither the access point nor a station session survive light sleep)
+      if (!accessPointMode && currentWiFiState == WIFI_STOPPED) {
+        dutyCycleNap();
+      }
+    } else if (isActuatorBusy()) {
+      // A scheduled open or close is still travelling or settling: deep
+      // sleep would cut it and lose its latency report, so wait for idle
+    } else {
+      captureSnapshot();
+      uint64_t sleepTime = dutyCycleSleepTime();
+
+      // Let the wake stub absorb the timer wakes with nothing to do
+      armWakeStub(sleepTime, idleWakesUntilNextWork(sleepTime));
+
+      // Enter deep sleep with multiple wake sources
+      enterDeepSleep(sleepTime, true, true);
+    }
   }
 }
 
-void handleLEDBlink() {
-  unsigned long currentMillis = millis();
-  
-  // Check if it's time to toggle the LED
-  if (currentMillis - previousMillis >= BLINK_INTERVAL) {
-    // Save the last time LED was toggled
-    previousMillis = currentMillis;
-    
-    // Toggle LED state
-    ledState = !ledState;
-    digitalWrite(LED_BUILTIN, ledState);
+/**
+ * Number of timer wakes that can be skipped before work is due
+ * The next work is the daily scheduled action: the last wake before it
+ * must run the full boot
+ * @param sleepTime Timer period in microseconds
+ */
+uint32_t idleWakesUntilNextWork(uint64_t sleepTime) {
+  if (!rtcTimeValid) {
+    return 0;
+  }
+
+  // The action hour is local time
+  uint32_t now = currentUnixTime();
+  uint32_t secondsUntilAction = nextLocalTime(now, config.actionHour, config.actionMinute) - now;
+  uint32_t periods = secondsUntilAction / (sleepTime / uS_TO_S_FACTOR);
+
+  return (periods > 0) ? periods - 1 : 0;
+}
+
+/**
+ * Dispatch queued events to the interested modules
+ */
+void handleEvents() {
+  Event event;
+  while (pollEvent(event)) {
+    Serial.print("Event: ");
+    Serial.print(getEventTypeString(event.type));
+    Serial.print(" | Time: ");
+    Serial.print(event.timestamp);
+    Serial.print(" | Value: ");
+    Serial.println(event.value);
+
+    appendJournalEvent(event);
+    updateStats(event);
+
+    // Any passage, even rejected, means cats are around
+    if (event.type == EVENT_DOOR_ENTRY || event.type == EVENT_DOOR_EXIT || event.type == EVENT_DOOR_REJECTED) {
+      dutyCycleActivity(event.timestamp);
+    }
   }
 }
 
@@ -134,8 +285,9 @@ void displayTimeStatus() {
     Serial.print("RTC Time Valid: ");
     Serial.println(rtcTimeValid ? "Yes" : "No");
     if (rtcTimeValid) {
+      char buffer[DATE_TIME_BUFFER_SIZE];
       Serial.print("RTC Time (UTC): ");
-      Serial.println(formatDateTime(rtc.now()));
+      Serial.println(formatDateTime(rtcNow(), buffer, sizeof(buffer)));
     }
   }
   
@@ -147,9 +299,10 @@ void displayCurrentTimes() {
   
   // Display RTC time
   if (rtcFound && rtcTimeValid) {
-    DateTime now = rtc.now();
+    DateTime now = rtcNow();
+    char buffer[DATE_TIME_BUFFER_SIZE];
     Serial.print("RTC (UTC): ");
-    Serial.print(formatDateTime(now));
+    Serial.print(formatDateTime(now, buffer, sizeof(buffer)));
     Serial.print(" | Unix: ");
     Serial.println(now.unixtime());
   }
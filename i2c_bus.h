@@ -0,0 +1,158 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+/*
+ * I2C bus manager
+ *
+ * A single owner task performs every transaction on the bus, at 400 kHz.
+ * Other tasks post a transaction (optional register write, optional read
+ * with repeated start) to its queue and block until it has been executed,
+ * so drivers for devices sharing the bus never interleave on the wire.
+ *
+ * Drivers should read contiguous registers in one burst with
+ * i2cReadRegisters() instead of one transaction per value.
+ */
+
+#include <Wire.h>
+#include "board.h"
+#include "metrics.h"
+
+// Configuration constants
+const uint8_t I2C_SDA_PIN = Board::I2C_SDA_PIN;
+const uint8_t I2C_SCL_PIN = Board::I2C_SCL_PIN;
+const uint32_t I2C_CLOCK_HZ = 400000;       // Fast mode, supported by the DS3231
+const uint16_t I2C_TIMEOUT_MS = 20;         // Per transaction, a stuck bus fails fast
+const uint8_t I2C_QUEUE_LENGTH = 4;         // Pending transactions
+const uint32_t I2C_TASK_STACK_SIZE = 3072;
+const UBaseType_t I2C_TASK_PRIORITY = 2;    // Above loop(), the bus is never left idle
+const size_t I2C_MAX_WRITE_LENGTH = 16;     // Register address + data for i2cWriteRegisters()
+
+/**
+ * One bus transaction, owned by the posting task until it completes
+ */
+struct I2CTransaction {
+  uint8_t address;           // 7-bit device address
+  const uint8_t* writeData;  // Bytes to write first (usually the register address)
+  size_t writeLength;
+  uint8_t* readData;         // Bytes to read after a repeated start
+  size_t readLength;
+  TaskHandle_t requester;    // Notified on completion
+  bool success;
+};
+
+// Global variables
+QueueHandle_t i2cQueue = nullptr;
+
+/**
+ * Execute one transaction on the bus, owner task only
+ * @param transaction Transaction to run, success is updated
+ */
+void executeI2CTransaction(I2CTransaction& transaction) {
+  bool success = true;
+
+  if (transaction.writeLength > 0) {
+    Wire.beginTransmission(transaction.address);
+    Wire.write(transaction.writeData, transaction.writeLength);
+    // Keep the bus for a repeated start when a read follows
+    success = (Wire.endTransmission(transaction.readLength == 0) == 0);
+  }
+
+  if (success && transaction.readLength > 0) {
+    size_t received = Wire.requestFrom(transaction.address, transaction.readLength);
+    success = (received == transaction.readLength);
+    for (size_t i = 0; i < received; i++) {
+      transaction.readData[i] = Wire.read();
+    }
+  }
+
+  transaction.success = success;
+}
+
+/**
+ * Bus owner task: runs the queued transactions in order
+ */
+void i2cBusTask(void* parameter) {
+  I2CTransaction* transaction;
+
+  for (;;) {
+    if (xQueueReceive(i2cQueue, &transaction, portMAX_DELAY) == pdTRUE) {
+      executeI2CTransaction(*transaction);
+      xTaskNotifyGive(transaction->requester);
+    }
+  }
+}
+
+/**
+ * Configure the bus and start its owner task
+ * Called once from setup(), before any device driver
+ */
+void initializeI2CBus() {
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, I2C_CLOCK_HZ);
+  Wire.setTimeOut(I2C_TIMEOUT_MS);
+
+  i2cQueue = xQueueCreate(I2C_QUEUE_LENGTH, sizeof(I2CTransaction*));
+  if (i2cQueue == nullptr ||
+      xTaskCreate(i2cBusTask, "i2c", I2C_TASK_STACK_SIZE, nullptr, I2C_TASK_PRIORITY, nullptr) != pdPASS) {
+    Serial.println("✗ Could not start the I2C bus task");
+    i2cQueue = nullptr;
+  }
+}
+
+/**
+ * Run a transaction through the owner task and wait for its completion
+ * @param address 7-bit device address
+ * @param writeData Bytes to write, may be nullptr if writeLength is 0
+ * @param writeLength Number of bytes to write
+ * @param readData Destination of the read, may be nullptr if readLength is 0
+ * @param readLength Number of bytes to read
+ * @return true if the device acknowledged and returned all the bytes
+ */
+bool i2cTransfer(uint8_t address, const uint8_t* writeData, size_t writeLength,
+                 uint8_t* readData, size_t readLength) {
+  if (i2cQueue == nullptr) {
+    return false;
+  }
+
+  // The owner task always completes, bounded by the Wire timeout
+  I2CTransaction transaction = {address, writeData, writeLength, readData, readLength,
+                                xTaskGetCurrentTaskHandle(), false};
+  I2CTransaction* pending = &transaction;
+  xQueueSend(i2cQueue, &pending, portMAX_DELAY);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  if (!transaction.success) {
+    metricIncrement(COUNTER_I2C_ERRORS);
+  }
+  return transaction.success;
+}
+
+/**
+ * Read consecutive registers in a single transaction
+ * @param address 7-bit device address
+ * @param firstRegister Address of the first register
+ * @param buffer Destination
+ * @param length Number of registers
+ */
+bool i2cReadRegisters(uint8_t address, uint8_t firstRegister, uint8_t* buffer, size_t length) {
+  return i2cTransfer(address, &firstRegister, 1, buffer, length);
+}
+
+/**
+ * Write consecutive registers in a single transaction
+ * @param address 7-bit device address
+ * @param firstRegister Address of the first register
+ * @param data Register values
+ * @param length Number of registers, at most I2C_MAX_WRITE_LENGTH - 1
+ */
+bool i2cWriteRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t length) {
+  if (length >= I2C_MAX_WRITE_LENGTH) {
+    return false;
+  }
+
+  uint8_t buffer[I2C_MAX_WRITE_LENGTH];
+  buffer[0] = firstRegister;
+  memcpy(buffer + 1, data, length);
+  return i2cTransfer(address, buffer, length + 1, nullptr, 0);
+}
+
+#endif // I2C_BUS_H
@@ -0,0 +1,353 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/*
+ * Event journal
+ *
+ * Every event dispatched by loop() is appended as an 8-byte record to the
+ * "journal" raw data partition (see partitions.csv). The partition holds
+ * two streams, each a ring of one-sector segments: the dispatched events,
+ * and the compacted telemetry (telemetry.h), which is written after the
+ * fact and would otherwise break the time order of the events. A segment
+ * starts with a header holding the magic of its stream and a sequence
+ * number, followed by JOURNAL_RECORDS_PER_SEGMENT records. When the head
+ * segment of a stream is full, its oldest one is erased and reused.
+ *
+ * A sparse index keeps, per segment, the timestamp range, the record count
+ * and a count per event type. It lives in RTC memory, so it survives deep
+ * sleep, and is rebuilt from flash on power-on. A query skips every
+ * segment whose range or type counts cannot match and, when the segment
+ * timestamps are in order, binary searches the first record in range, so
+ * the flash read cost follows the size of the result, not of the log.
+ */
+
+#include <esp_partition.h>
+#include <esp_sleep.h>
+#include <spi_flash_mmap.h>
+#include "events.h"
+
+// Configuration constants
+const char* const JOURNAL_PARTITION_LABEL = "journal";
+const uint8_t JOURNAL_MAX_SEGMENTS = 32;
+const uint16_t JOURNAL_RECORDS_PER_SEGMENT = SPI_FLASH_SEC_SIZE / sizeof(Event) - 1;  // First slot: header
+const uint32_t JOURNAL_MAGIC[] = {0x4C4E524A, 0x4D4C544A};  // "JRNL", "JTLM"
+const uint8_t JOURNAL_TELEMETRY_EIGHTHS = 3;  // Share of the partition for telemetry: 12 of 32 segments
+const uint16_t JOURNAL_READ_BATCH = 32;      // Records per flash read while querying
+const uint16_t JOURNAL_QUERY_MAX_LIMIT = 1000;
+
+static_assert(sizeof(Event) == 8, "Journal records are 8 bytes");
+
+enum JournalStream : uint8_t {
+  JOURNAL_EVENTS,           // Events dispatched by loop()
+  JOURNAL_TELEMETRY,        // Compacted telemetry windows
+  JOURNAL_STREAM_COUNT
+};
+
+/**
+ * First record slot of a segment
+ */
+struct JournalSegmentHeader {
+  uint32_t magic;
+  uint32_t sequence;
+};
+
+static_assert(sizeof(JournalSegmentHeader) == sizeof(Event), "The header takes one record slot");
+
+/**
+ * Sparse index entry of a segment
+ */
+struct JournalSegmentIndex {
+  uint32_t sequence;        // 0 = segment not in use
+  uint32_t minTimestamp;
+  uint32_t maxTimestamp;
+  uint16_t count;           // Records written
+  bool sorted;              // Timestamps never decrease: binary search allowed
+  uint16_t typeCounts[EVENT_TYPE_COUNT];
+};
+
+/**
+ * Append position of a stream
+ */
+struct JournalStreamState {
+  uint8_t headSegment;      // Segment receiving the appends
+  uint32_t nextSequence;
+};
+
+/**
+ * Journal state in RTC memory, rebuilt from flash on power-on
+ */
+struct JournalState {
+  JournalSegmentIndex segments[JOURNAL_MAX_SEGMENTS];
+  JournalStreamState streams[JOURNAL_STREAM_COUNT];
+};
+
+/**
+ * Journal query, the time range is inclusive
+ */
+struct JournalQuery {
+  uint32_t from;
+  uint32_t to;
+  int16_t type;             // EventType, -1 for any
+  uint16_t limit;           // Maximum number of results
+  JournalStream stream;
+};
+
+// Global variables
+RTC_DATA_ATTR JournalState journal;
+const esp_partition_t* journalPartition = nullptr;
+uint8_t journalSegmentCount = 0;
+uint8_t journalStreamFirst[JOURNAL_STREAM_COUNT];  // First segment of each stream
+uint8_t journalStreamSize[JOURNAL_STREAM_COUNT];   // Segments of each stream
+uint32_t journalRecordsRead = 0;  // Records read by the last query
+
+size_t journalRecordOffset(uint8_t segment, uint16_t record) {
+  return (size_t)segment * SPI_FLASH_SEC_SIZE + (record + 1) * sizeof(Event);
+}
+
+bool isErasedRecord(const Event& record) {
+  const uint8_t* bytes = (const uint8_t*)&record;
+  for (size_t i = 0; i < sizeof(record); i++) {
+    if (bytes[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Add a record to the index entry of its segment
+ */
+void indexJournalRecord(JournalSegmentIndex& index, const Event& record) {
+  if (index.count == 0) {
+    index.minTimestamp = record.timestamp;
+    index.maxTimestamp = record.timestamp;
+  } else {
+    index.sorted = index.sorted && record.timestamp >= index.maxTimestamp;
+    index.minTimestamp = min(index.minTimestamp, record.timestamp);
+    index.maxTimestamp = max(index.maxTimestamp, record.timestamp);
+  }
+  if (record.type < EVENT_TYPE_COUNT) {
+    index.typeCounts[record.type]++;
+  }
+  index.count++;
+}
+
+/**
+ * Rebuild the index entry of a segment from flash
+ */
+void scanJournalSegment(JournalStream stream, uint8_t segment) {
+  JournalSegmentIndex& index = journal.segments[segment];
+  memset(&index, 0, sizeof(index));
+  index.sorted = true;
+
+  JournalSegmentHeader header;
+  esp_partition_read(journalPartition, (size_t)segment * SPI_FLASH_SEC_SIZE, &header, sizeof(header));
+  if (header.magic != JOURNAL_MAGIC[stream]) {
+    return;
+  }
+  index.sequence = header.sequence;
+
+  Event records[JOURNAL_READ_BATCH];
+  for (uint16_t first = 0; first < JOURNAL_RECORDS_PER_SEGMENT; first += JOURNAL_READ_BATCH) {
+    uint16_t batch = min((uint16_t)(JOURNAL_RECORDS_PER_SEGMENT - first), JOURNAL_READ_BATCH);
+    esp_partition_read(journalPartition, journalRecordOffset(segment, first), records, batch * sizeof(Event));
+    for (uint16_t i = 0; i < batch; i++) {
+      if (isErasedRecord(records[i])) {
+        return;
+      }
+      indexJournalRecord(index, records[i]);
+    }
+  }
+}
+
+/**
+ * Rebuild the whole index and find the head segment of each stream, power-on only
+ */
+void rebuildJournalIndex() {
+  memset(&journal, 0, sizeof(journal));
+  uint32_t total[JOURNAL_STREAM_COUNT] = {};
+
+  for (uint8_t stream = 0; stream < JOURNAL_STREAM_COUNT; stream++) {
+    JournalStreamState& state = journal.streams[stream];
+    state.headSegment = journalStreamFirst[stream];
+    for (uint8_t n = 0; n < journalStreamSize[stream]; n++) {
+      uint8_t segment = journalStreamFirst[stream] + n;
+      scanJournalSegment((JournalStream)stream, segment);
+      const JournalSegmentIndex& index = journal.segments[segment];
+      if (index.sequence >= state.nextSequence) {
+        state.nextSequence = index.sequence + 1;
+        state.headSegment = segment;
+      }
+      total[stream] += index.count;
+    }
+    if (state.nextSequence == 0) {
+      state.nextSequence = 1;  // Blank stream, 0 marks unused segments
+    }
+  }
+
+  Serial.print("✓ Event journal: ");
+  Serial.print(total[JOURNAL_EVENTS]);
+  Serial.print(" events, ");
+  Serial.print(total[JOURNAL_TELEMETRY]);
+  Serial.println(" telemetry records");
+}
+
+/**
+ * Locate the journal partition, rebuild the index on power-on
+ * @param wakeReason Wake cause of this boot
+ */
+void initializeJournal(esp_sleep_wakeup_cause_t wakeReason) {
+  journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                              JOURNAL_PARTITION_LABEL);
+  if (journalPartition == nullptr) {
+    Serial.println("⚠ No journal partition, events are not stored");
+    return;
+  }
+  journalSegmentCount = min((uint32_t)JOURNAL_MAX_SEGMENTS, journalPartition->size / SPI_FLASH_SEC_SIZE);
+  journalStreamSize[JOURNAL_TELEMETRY] = max(1, journalSegmentCount * JOURNAL_TELEMETRY_EIGHTHS / 8);
+  journalStreamSize[JOURNAL_EVENTS] = journalSegmentCount - journalStreamSize[JOURNAL_TELEMETRY];
+  journalStreamFirst[JOURNAL_EVENTS] = 0;
+  journalStreamFirst[JOURNAL_TELEMETRY] = journalStreamSize[JOURNAL_EVENTS];
+
+  // The index in RTC memory is only meaningful after a deep sleep wake
+  if (wakeReason == ESP_SLEEP_WAKEUP_UNDEFINED) {
+    rebuildJournalIndex();
+  }
+}
+
+/**
+ * Erase a segment and make it the head of its stream, drops the events it held
+ */
+bool startJournalSegment(JournalStream stream, uint8_t segment) {
+  JournalStreamState& state = journal.streams[stream];
+  JournalSegmentHeader header = {JOURNAL_MAGIC[stream], state.nextSequence};
+  size_t offset = (size_t)segment * SPI_FLASH_SEC_SIZE;
+  if (esp_partition_erase_range(journalPartition, offset, SPI_FLASH_SEC_SIZE) != ESP_OK ||
+      esp_partition_write(journalPartition, offset, &header, sizeof(header)) != ESP_OK) {
+    Serial.println("✗ Event journal: segment start failed");
+    return false;
+  }
+
+  JournalSegmentIndex& index = journal.segments[segment];
+  memset(&index, 0, sizeof(index));
+  index.sequence = state.nextSequence++;
+  index.sorted = true;
+  state.headSegment = segment;
+  return true;
+}
+
+/**
+ * Segment of a stream n positions after the head, wrapping within the stream
+ */
+uint8_t journalStreamSegment(JournalStream stream, uint8_t n) {
+  uint8_t first = journalStreamFirst[stream];
+  return first + (journal.streams[stream].headSegment - first + n) % journalStreamSize[stream];
+}
+
+/**
+ * Append an event to the journal
+ * @param event Event to store
+ * @param stream Stream receiving the record
+ * @return false if there is no journal or the write failed
+ */
+bool appendJournalEvent(const Event& event, JournalStream stream = JOURNAL_EVENTS) {
+  if (journalPartition == nullptr) {
+    return false;
+  }
+
+  JournalStreamState& state = journal.streams[stream];
+  JournalSegmentIndex* head = &journal.segments[state.headSegment];
+  if (head->sequence == 0 || head->count >= JOURNAL_RECORDS_PER_SEGMENT) {
+    uint8_t next = (head->sequence == 0) ? state.headSegment : journalStreamSegment(stream, 1);
+    if (!startJournalSegment(stream, next)) {
+      return false;
+    }
+    head = &journal.segments[next];
+  }
+
+  if (esp_partition_write(journalPartition, journalRecordOffset(state.headSegment, head->count),
+                          &event, sizeof(event)) != ESP_OK) {
+    Serial.println("✗ Event journal: write failed");
+    return false;
+  }
+  indexJournalRecord(*head, event);
+  return true;
+}
+
+/**
+ * Whether a segment may hold records matching the query
+ */
+bool journalSegmentMatches(const JournalSegmentIndex& index, const JournalQuery& query) {
+  return index.sequence != 0 && index.count > 0 &&
+         index.maxTimestamp >= query.from && index.minTimestamp <= query.to &&
+         (query.type < 0 || index.typeCounts[query.type] > 0);
+}
+
+/**
+ * First record of a sorted segment with a timestamp >= from
+ */
+uint16_t journalLowerBound(uint8_t segment, uint16_t count, uint32_t from) {
+  uint16_t low = 0;
+  uint16_t high = count;
+  while (low < high) {
+    uint16_t middle = (low + high) / 2;
+    Event record;
+    esp_partition_read(journalPartition, journalRecordOffset(segment, middle), &record, sizeof(record));
+    journalRecordsRead++;
+    if (record.timestamp < from) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ * Visit the records of a stream matching a query, oldest first
+ * @param query Stream, time range, type and limit
+ * @param visit Called with each matching Event
+ * @return Number of records visited
+ */
+template <typename Visitor>
+uint16_t queryJournal(const JournalQuery& query, Visitor visit) {
+  journalRecordsRead = 0;
+  if (journalPartition == nullptr) {
+    return 0;
+  }
+
+  uint16_t matched = 0;
+  Event records[JOURNAL_READ_BATCH];
+
+  // Oldest segment first: the one after the head
+  for (uint8_t n = 1; n <= journalStreamSize[query.stream] && matched < query.limit; n++) {
+    uint8_t segment = journalStreamSegment(query.stream, n);
+    const JournalSegmentIndex& index = journal.segments[segment];
+    if (!journalSegmentMatches(index, query)) {
+      continue;
+    }
+
+    uint16_t first = index.sorted ? journalLowerBound(segment, index.count, query.from) : 0;
+    bool done = false;
+    while (first < index.count && !done) {
+      uint16_t batch = min((uint16_t)(index.count - first), JOURNAL_READ_BATCH);
+      esp_partition_read(journalPartition, journalRecordOffset(segment, first), records, batch * sizeof(Event));
+      journalRecordsRead += batch;
+      first += batch;
+
+      for (uint16_t i = 0; i < batch && !done; i++) {
+        const Event& record = records[i];
+        if (index.sorted && record.timestamp > query.to) {
+          done = true;  // Sorted: nothing further in range
+        } else if (record.timestamp >= query.from && record.timestamp <= query.to &&
+                   (query.type < 0 || record.type == query.type)) {
+          visit(record);
+          done = (++matched >= query.limit);
+        }
+      }
+    }
+  }
+  return matched;
+}
+
+#endif // JOURNAL_H
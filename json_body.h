@@ -0,0 +1,197 @@
+#ifndef JSON_BODY_H
+#define JSON_BODY_H
+
+/*
+ * Bounded-memory JSON request bodies
+ *
+ * POST handlers registered with handleRequestBodyChunk() as upload function
+ * receive their body through the WebServer raw interface, chunk by chunk,
+ * into a fixed buffer: the server never builds the "plain" String. Bodies
+ * announcing a Content-Length above MAX_REQUEST_BODY_SIZE are rejected with
+ * 413 before any byte is read.
+ *
+ * The body is then deserialized into a JsonDocument backed by a fixed arena
+ * instead of the heap, with a filter so that only known fields are
+ * materialized. Peak memory of a config save is therefore bounded by
+ * MAX_REQUEST_BODY_SIZE + JSON_ARENA_SIZE, both statically allocated.
+ */
+
+#include <WebServer.h>
+#include <ArduinoJson.h>
+
+// Configuration constants
+const size_t MAX_REQUEST_BODY_SIZE = 1536;  // 5 networks with maximum length credentials
+const size_t JSON_ARENA_SIZE = 3072;        // Parsed document, filtered fields only
+
+/**
+ * ArduinoJson allocator serving memory from a static buffer
+ * Bump allocation, the whole arena is released by reset() before each
+ * request. The last block can grow or shrink in place, which covers the
+ * string building pattern of the deserializer.
+ */
+class ArenaAllocator : public ArduinoJson::Allocator {
+ public:
+  void* allocate(size_t size) override {
+    size = align(size);
+    if (used_ + size > JSON_ARENA_SIZE) {
+      return nullptr;
+    }
+    last_ = buffer_ + used_;
+    used_ += size;
+    if (used_ > peak_) {
+      peak_ = used_;
+    }
+    return last_;
+  }
+
+  void deallocate(void* ptr) override {
+    // Only the last block can be given back
+    if (ptr != nullptr && ptr == last_) {
+      used_ = last_ - buffer_;
+      last_ = nullptr;
+    }
+  }
+
+  void* reallocate(void* ptr, size_t newSize) override {
+    if (ptr == nullptr) {
+      return allocate(newSize);
+    }
+
+    // Last block: resize in place
+    if (ptr == last_) {
+      size_t offset = last_ - buffer_;
+      if (offset + align(newSize) > JSON_ARENA_SIZE) {
+        return nullptr;
+      }
+      used_ = offset + align(newSize);
+      if (used_ > peak_) {
+        peak_ = used_;
+      }
+      return ptr;
+    }
+
+    // Older block: copy to a new one (its size is bounded by the arena end)
+    uint8_t* block = (uint8_t*)allocate(newSize);
+    if (block != nullptr) {
+      memcpy(block, ptr, min(newSize, (size_t)(buffer_ + JSON_ARENA_SIZE - (uint8_t*)ptr)));
+    }
+    return block;
+  }
+
+  // Release everything, called before each deserialization
+  void reset() {
+    used_ = 0;
+    last_ = nullptr;
+  }
+
+  size_t used() const { return used_; }
+  size_t peak() const { return peak_; }
+
+ private:
+  static size_t align(size_t size) {
+    return (size + 3) & ~(size_t)3;
+  }
+
+  alignas(8) uint8_t buffer_[JSON_ARENA_SIZE];
+  size_t used_ = 0;
+  size_t peak_ = 0;
+  uint8_t* last_ = nullptr;
+};
+
+// Global variables
+ArenaAllocator jsonArena;
+char requestBody[MAX_REQUEST_BODY_SIZE + 1];
+size_t requestBodyLength = 0;
+bool requestBodyTooLarge = false;
+bool requestBodyRejected = false;  // 413 already sent and connection closed at RAW_START
+
+/**
+ * Forget the collected body once the handler is done with it, so a later
+ * request not going through the upload callback (e.g. form encoded)
+ * finds no body instead of this one
+ */
+void releaseRequestBody() {
+  requestBodyLength = 0;
+  requestBodyTooLarge = false;
+  requestBodyRejected = false;
+}
+
+/**
+ * WebServer upload callback collecting the raw body of a POST request
+ * Called by the server for every chunk while the request is parsed
+ * @param server Server parsing the request
+ */
+void handleRequestBodyChunk(WebServer& server) {
+  HTTPRaw& raw = server.raw();
+
+  switch (raw.status) {
+    case RAW_START:
+      requestBodyLength = 0;
+      requestBodyTooLarge = (server.clientContentLength() > MAX_REQUEST_BODY_SIZE);
+      requestBodyRejected = requestBodyTooLarge;
+      if (requestBodyRejected) {
+        // Reject before the body is read, closing makes the server drop the request
+        server.send(413, "application/json", "{\"success\":false,\"error\":\"Body too large\"}");
+        server.client().stop();
+      }
+      break;
+
+    case RAW_WRITE:
+      if (requestBodyTooLarge) {
+        break;
+      }
+      if (requestBodyLength + raw.currentSize > MAX_REQUEST_BODY_SIZE) {
+        requestBodyTooLarge = true;
+        break;
+      }
+      memcpy(requestBody + requestBodyLength, raw.buf, raw.currentSize);
+      requestBodyLength += raw.currentSize;
+      break;
+
+    case RAW_END:
+      requestBody[requestBodyLength] = '\0';
+      break;
+
+    case RAW_ABORTED:
+      // No handler runs for an aborted request: clear the rejection too,
+      // otherwise the next request would be taken as already answered
+      releaseRequestBody();
+      break;
+  }
+}
+
+/**
+ * Check the collected body and send the error response if it is unusable
+ * @param server Server handling the request
+ * @return true if the body can be parsed
+ */
+bool checkRequestBody(WebServer& server) {
+  if (requestBodyRejected) {
+    return false;  // Already answered when the request started
+  }
+  if (requestBodyTooLarge) {
+    server.send(413, "application/json", "{\"success\":false,\"error\":\"Body too large\"}");
+    return false;
+  }
+  if (requestBodyLength == 0) {
+    server.send(400, "application/json", "{\"success\":false,\"error\":\"No data\"}");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Deserialize a body into an arena backed document keeping only the fields
+ * present in the filter
+ * @param doc Document created with &jsonArena as allocator
+ * @param body JSON text
+ * @param length Length of the text
+ * @param filter Fields to materialize
+ */
+DeserializationError deserializeBoundedJson(JsonDocument& doc, const char* body, size_t length,
+                                            const JsonDocument& filter) {
+  return deserializeJson(doc, body, length, DeserializationOption::Filter(filter),
+                         DeserializationOption::NestingLimit(4));
+}
+
+#endif // JSON_BODY_H
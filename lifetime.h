@@ -0,0 +1,207 @@
+#ifndef LIFETIME_H
+#define LIFETIME_H
+
+/*
+ * Lifetime counters
+ *
+ * Counters kept for the whole life of the unit (boots, wakes per cause,
+ * door passages, actuator cycles, WiFi sessions). Incrementing only adds
+ * to RTC slow memory, which survives deep sleep, so counting costs nothing
+ * on the wake path.
+ *
+ * The counters are checkpointed to the "counters" raw data partition (see
+ * partitions.csv) every LIFETIME_CHECKPOINT_INTERVAL increments, and at
+ * every opportunity once the battery is low, and reloaded on power-on.
+ * A battery swap loses at most the increments since the last checkpoint.
+ *
+ * Wear leveling: the partition is a ring of fixed-size records, each
+ * checkpoint appends one with a sequence number and a CRC. A sector is
+ * erased only when the ring reaches it, so every sector sees one erase per
+ * (records per partition) checkpoints. On load the valid record with the
+ * highest sequence wins; a record torn by a power loss fails its CRC and
+ * the previous one is used.
+ */
+
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <esp_sleep.h>
+#include <spi_flash_mmap.h>
+
+// Counters, the order is part of the flash layout: append only
+enum LifetimeCounter : uint8_t {
+  LIFETIME_BOOTS,            // Every start of the application
+  LIFETIME_POWER_ONS,        // Starts not caused by a deep sleep wake
+  LIFETIME_WAKES_TIMER,      // Including the wakes absorbed by the wake stub
+  LIFETIME_WAKES_EXT0,       // Button
+  LIFETIME_WAKES_EXT1,       // Door sensors
+  LIFETIME_WAKES_OTHER,
+  LIFETIME_DOOR_PASSAGES,    // Entries and exits
+  LIFETIME_ACTUATOR_CYCLES,  // Power-up of the lock actuator
+  LIFETIME_WIFI_SESSIONS,    // Successful station connections
+  LIFETIME_COUNT
+};
+
+// Configuration constants
+const char* const LIFETIME_PARTITION_LABEL = "counters";
+const uint32_t LIFETIME_CHECKPOINT_INTERVAL = 32;  // Increments between flash writes
+const uint8_t LIFETIME_RECORD_SLOTS = 14;          // Counter room in a record
+const uint32_t LIFETIME_ERASED = 0xFFFFFFFF;       // Sequence of an erased record
+
+/**
+ * Flash record, 64 bytes so that records never straddle sectors
+ */
+struct LifetimeRecord {
+  uint32_t sequence;
+  uint32_t values[LIFETIME_RECORD_SLOTS];
+  uint32_t crc;
+};
+
+static_assert(sizeof(LifetimeRecord) == 64, "LifetimeRecord must stay 64 bytes");
+static_assert(SPI_FLASH_SEC_SIZE % sizeof(LifetimeRecord) == 0, "Records must tile a sector");
+static_assert(LIFETIME_COUNT <= LIFETIME_RECORD_SLOTS, "Too many lifetime counters for a record");
+
+/**
+ * Counter state in RTC memory, reloaded from flash on power-on
+ */
+struct LifetimeState {
+  uint32_t values[LIFETIME_COUNT];
+  uint32_t pending;      // Increments not yet in flash
+  uint32_t sequence;     // Sequence of the last record written
+  uint32_t nextRecord;   // Ring position of the next record
+};
+
+// Global variables
+RTC_DATA_ATTR LifetimeState lifetime;
+const esp_partition_t* lifetimePartition = nullptr;
+
+const char* const LIFETIME_LABELS[LIFETIME_COUNT] = {
+  "boots", "power_ons", "wakes_timer", "wakes_ext0", "wakes_ext1", "wakes_other",
+  "door_passages", "actuator_cycles", "wifi_sessions"
+};
+
+/**
+ * Add to a counter, RTC memory only
+ */
+inline void lifetimeIncrement(LifetimeCounter counter, uint32_t amount = 1) {
+  lifetime.values[counter] += amount;
+  lifetime.pending += amount;
+}
+
+inline uint32_t lifetimeCounter(LifetimeCounter counter) {
+  return lifetime.values[counter];
+}
+
+uint32_t computeLifetimeRecordCrc(const LifetimeRecord& record) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&record, offsetof(LifetimeRecord, crc));
+}
+
+uint32_t lifetimeRecordCount() {
+  return lifetimePartition->size / sizeof(LifetimeRecord);
+}
+
+/**
+ * Find the newest valid record and restore the counters from it
+ * Counters start from zero on a blank partition
+ */
+void loadLifetimeCounters() {
+  memset(&lifetime, 0, sizeof(lifetime));
+
+  uint32_t records = lifetimeRecordCount();
+  uint32_t newest = records;
+  LifetimeRecord record;
+  for (uint32_t i = 0; i < records; i++) {
+    if (esp_partition_read(lifetimePartition, i * sizeof(record), &record, sizeof(record)) != ESP_OK) {
+      continue;
+    }
+    if (record.sequence == LIFETIME_ERASED || record.crc != computeLifetimeRecordCrc(record)) {
+      continue;
+    }
+    if (newest == records || record.sequence > lifetime.sequence) {
+      newest = i;
+      lifetime.sequence = record.sequence;
+      memcpy(lifetime.values, record.values, sizeof(lifetime.values));
+    }
+  }
+
+  lifetime.nextRecord = (newest == records) ? 0 : (newest + 1) % records;
+}
+
+/**
+ * Prepare the counters and count this boot
+ * @param wakeReason Wake cause of this boot
+ */
+void initializeLifetimeCounters(esp_sleep_wakeup_cause_t wakeReason) {
+  lifetimePartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                               LIFETIME_PARTITION_LABEL);
+
+  // RTC memory is only meaningful after a deep sleep wake
+  if (wakeReason == ESP_SLEEP_WAKEUP_UNDEFINED) {
+    if (lifetimePartition != nullptr) {
+      loadLifetimeCounters();
+      Serial.print("✓ Lifetime counters loaded, ");
+      Serial.print(lifetime.values[LIFETIME_BOOTS]);
+      Serial.println(" boots");
+    } else {
+      memset(&lifetime, 0, sizeof(lifetime));
+      Serial.println("⚠ No counters partition, lifetime counters not persisted");
+    }
+  }
+
+  lifetimeIncrement(LIFETIME_BOOTS);
+  switch (wakeReason) {
+    case ESP_SLEEP_WAKEUP_UNDEFINED: lifetimeIncrement(LIFETIME_POWER_ONS); break;
+    case ESP_SLEEP_WAKEUP_TIMER: lifetimeIncrement(LIFETIME_WAKES_TIMER); break;
+    case ESP_SLEEP_WAKEUP_EXT0: lifetimeIncrement(LIFETIME_WAKES_EXT0); break;
+    case ESP_SLEEP_WAKEUP_EXT1: lifetimeIncrement(LIFETIME_WAKES_EXT1); break;
+    default: lifetimeIncrement(LIFETIME_WAKES_OTHER); break;
+  }
+}
+
+/**
+ * Write the counters to flash when enough increments are pending
+ * Called from loop(), before deep sleep
+ * @param force Write any pending increment (low battery: a swap may follow)
+ * @return true if a record was written
+ */
+bool checkpointLifetimeCounters(bool force) {
+  if (lifetimePartition == nullptr || lifetime.pending == 0 ||
+      (!force && lifetime.pending < LIFETIME_CHECKPOINT_INTERVAL)) {
+    return false;
+  }
+
+  LifetimeRecord record;
+  memset((void*)&record, 0, sizeof(record));
+  record.sequence = lifetime.sequence + 1;
+  memcpy(record.values, lifetime.values, sizeof(lifetime.values));
+  record.crc = computeLifetimeRecordCrc(record);
+
+  // Entering a sector: erase it, this drops the oldest records of the ring
+  size_t offset = lifetime.nextRecord * sizeof(record);
+  if (offset % SPI_FLASH_SEC_SIZE == 0 &&
+      esp_partition_erase_range(lifetimePartition, offset, SPI_FLASH_SEC_SIZE) != ESP_OK) {
+    Serial.println("✗ Lifetime counters: sector erase failed");
+    return false;
+  }
+  if (esp_partition_write(lifetimePartition, offset, &record, sizeof(record)) != ESP_OK) {
+    Serial.println("✗ Lifetime counters: write failed");
+    return false;
+  }
+
+  lifetime.sequence = record.sequence;
+  lifetime.nextRecord = (lifetime.nextRecord + 1) % lifetimeRecordCount();
+  lifetime.pending = 0;
+  return true;
+}
+
+/**
+ * Print the counters in the Prometheus text format
+ */
+void printLifetimeCounters(Print& out) {
+  out.println("# TYPE gattaiola_lifetime_total counter");
+  for (uint8_t i = 0; i < LIFETIME_COUNT; i++) {
+    out.printf("gattaiola_lifetime_total{counter=\"%s\"} %lu\n", LIFETIME_LABELS[i],
+               (unsigned long)lifetime.values[i]);
+  }
+}
+
+#endif // LIFETIME_H
@@ -0,0 +1,279 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * Metrics registry
+ *
+ * Counters and fixed-bucket histograms are std::atomic arrays indexed by
+ * enum, so an update on a hot path is a single atomic add with no lookup
+ * and no allocation. The registry is exposed on /metrics in the Prometheus
+ * text format (see printMetrics()).
+ *
+ * Counters that must survive deep sleep are copied to RTC slow memory by
+ * metricsBeforeSleep() and restored by initializeMetrics() on wake. They are
+ * not updated in place there because the Xtensa atomic instructions only
+ * operate on internal SRAM.
+ */
+
+#include <atomic>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+
+// Counters
+enum MetricCounter : uint8_t {
+  COUNTER_WAKE_POWER_ON,     // Boots not caused by a deep sleep wake up
+  COUNTER_WAKE_TIMER,
+  COUNTER_WAKE_EXT0,
+  COUNTER_WAKE_EXT1,
+  COUNTER_WAKE_OTHER,
+  COUNTER_WAKE_STUB_SKIPPED, // Timer wakes absorbed by the wake stub
+  COUNTER_I2C_ERRORS,
+  COUNTER_NVS_WRITES,
+  COUNTER_WIFI_CONNECTS,
+  COUNTER_WIFI_FAILURES,
+  COUNTER_HTTP_REQUESTS,     // Session only
+  COUNTER_COUNT
+};
+
+// Counters up to (and excluding) this one are kept across deep sleep
+const uint8_t PERSISTENT_COUNTER_COUNT = COUNTER_HTTP_REQUESTS;
+
+// Routes with a latency histogram
+enum MetricRoute : uint8_t {
+  ROUTE_ROOT,
+  ROUTE_STATUS,
+  ROUTE_CONFIG_GET,
+  ROUTE_CONFIG_POST,
+  ROUTE_NETWORKS_GET,
+  ROUTE_NETWORKS_POST,
+  ROUTE_TIME,
+  ROUTE_METRICS,
+  ROUTE_SELFTEST,
+  ROUTE_EVENTS,
+  ROUTE_STATS,
+  ROUTE_HISTORY,
+  ROUTE_NOT_FOUND,
+  ROUTE_COUNT
+};
+
+// Histogram bucket upper bounds, the last bucket is +Inf
+const uint8_t HISTOGRAM_BUCKETS = 8;
+const uint32_t REQUEST_LATENCY_BOUNDS_US[HISTOGRAM_BUCKETS - 1] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000
+};
+const uint32_t WIFI_CONNECT_BOUNDS_US[HISTOGRAM_BUCKETS - 1] = {
+  500000, 1000000, 2000000, 3000000, 5000000, 8000000, 12000000
+};
+
+/**
+ * Fixed-bucket histogram of durations
+ */
+struct Histogram {
+  const uint32_t* bounds;                           // HISTOGRAM_BUCKETS - 1 upper bounds (us)
+  std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS]; // Non cumulative counts
+  std::atomic<uint32_t> count;
+  std::atomic<uint64_t> sumUs;
+};
+
+/**
+ * Metrics kept in RTC slow memory across deep sleep
+ */
+struct PersistentMetrics {
+  uint32_t counters[PERSISTENT_COUNTER_COUNT];
+  uint32_t wifiConnectBuckets[HISTOGRAM_BUCKETS];
+  uint32_t wifiConnectCount;
+  uint64_t wifiConnectSumUs;
+  uint32_t minFreeHeap;      // Lowest free heap seen over all wake cycles
+};
+
+// Global variables
+std::atomic<uint32_t> metricCounters[COUNTER_COUNT];
+Histogram routeLatency[ROUTE_COUNT];
+Histogram wifiConnectDuration;
+RTC_DATA_ATTR PersistentMetrics rtcMetrics;  // Zeroed on power on
+uint32_t metricWakeHandlerLatencyUs = 0;     // Boot to external wake handler, 0 if not an external wake
+uint32_t metricBatteryMillivolts = 0;
+int8_t metricWiFiTxPowerQuarterDbm = 0;      // WiFi TX power, 0.25 dBm steps
+int8_t metricWiFiRssi = 0;                   // RSSI of the current connection, dBm
+
+const char* const ROUTE_LABELS[ROUTE_COUNT] = {
+  "/", "/api/status", "GET /api/config", "POST /api/config",
+  "GET /api/networks", "POST /api/networks", "/api/time", "/metrics", "/api/selftest", "/api/events", "/api/stats",
+  "/api/history", "not_found"
+};
+
+/**
+ * Add one to a counter, safe from any task
+ */
+inline void metricIncrement(MetricCounter counter, uint32_t amount = 1) {
+  metricCounters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+/**
+ * Record a duration in a histogram
+ * @param histogram Destination histogram
+ * @param durationUs Duration in microseconds
+ */
+void histogramObserve(Histogram& histogram, uint32_t durationUs) {
+  uint8_t bucket = 0;
+  while (bucket < HISTOGRAM_BUCKETS - 1 && durationUs > histogram.bounds[bucket]) {
+    bucket++;
+  }
+  histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  histogram.count.fetch_add(1, std::memory_order_relaxed);
+  histogram.sumUs.fetch_add(durationUs, std::memory_order_relaxed);
+}
+
+/**
+ * Restore persistent metrics and count the wake up reason
+ * Called once at boot
+ */
+void initializeMetrics(esp_sleep_wakeup_cause_t wakeupReason) {
+  for (uint8_t i = 0; i < ROUTE_COUNT; i++) {
+    routeLatency[i].bounds = REQUEST_LATENCY_BOUNDS_US;
+  }
+  wifiConnectDuration.bounds = WIFI_CONNECT_BOUNDS_US;
+
+  for (uint8_t i = 0; i < PERSISTENT_COUNTER_COUNT; i++) {
+    metricCounters[i].store(rtcMetrics.counters[i], std::memory_order_relaxed);
+  }
+  for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    wifiConnectDuration.buckets[i].store(rtcMetrics.wifiConnectBuckets[i], std::memory_order_relaxed);
+  }
+  wifiConnectDuration.count.store(rtcMetrics.wifiConnectCount, std::memory_order_relaxed);
+  wifiConnectDuration.sumUs.store(rtcMetrics.wifiConnectSumUs, std::memory_order_relaxed);
+
+  switch (wakeupReason) {
+    case ESP_SLEEP_WAKEUP_UNDEFINED: metricIncrement(COUNTER_WAKE_POWER_ON); break;
+    case ESP_SLEEP_WAKEUP_TIMER: metricIncrement(COUNTER_WAKE_TIMER); break;
+    case ESP_SLEEP_WAKEUP_EXT0: metricIncrement(COUNTER_WAKE_EXT0); break;
+    case ESP_SLEEP_WAKEUP_EXT1: metricIncrement(COUNTER_WAKE_EXT1); break;
+    default: metricIncrement(COUNTER_WAKE_OTHER); break;
+  }
+}
+
+/**
+ * Lowest free heap over all wake cycles, updated with the current session
+ */
+uint32_t metricsMinFreeHeap() {
+  uint32_t sessionMin = ESP.getMinFreeHeap();
+  if (rtcMetrics.minFreeHeap == 0 || sessionMin < rtcMetrics.minFreeHeap) {
+    rtcMetrics.minFreeHeap = sessionMin;
+  }
+  return rtcMetrics.minFreeHeap;
+}
+
+/**
+ * Copy the persistent metrics to RTC memory
+ * Called right before entering deep sleep
+ */
+void metricsBeforeSleep() {
+  for (uint8_t i = 0; i < PERSISTENT_COUNTER_COUNT; i++) {
+    rtcMetrics.counters[i] = metricCounters[i].load(std::memory_order_relaxed);
+  }
+  for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    rtcMetrics.wifiConnectBuckets[i] = wifiConnectDuration.buckets[i].load(std::memory_order_relaxed);
+  }
+  rtcMetrics.wifiConnectCount = wifiConnectDuration.count.load(std::memory_order_relaxed);
+  rtcMetrics.wifiConnectSumUs = wifiConnectDuration.sumUs.load(std::memory_order_relaxed);
+  metricsMinFreeHeap();
+}
+
+/**
+ * Wrap a request handler to count it and record its latency
+ * Usage: server.on("/", HTTP_GET, timedHandler<ROUTE_ROOT, handleRoot>);
+ */
+template <MetricRoute route, void (*handler)()>
+void timedHandler() {
+  int64_t start = esp_timer_get_time();
+  handler();
+  histogramObserve(routeLatency[route], (uint32_t)(esp_timer_get_time() - start));
+  metricIncrement(COUNTER_HTTP_REQUESTS);
+}
+
+/**
+ * Print a histogram in the Prometheus text format
+ * @param out Destination
+ * @param name Metric name without suffix
+ * @param labels Extra labels ("" or e.g. "route=\"/\"")
+ */
+void printHistogram(Print& out, const char* name, const char* labels, const Histogram& histogram) {
+  const char* separator = labels[0] ? "," : "";
+  uint32_t cumulative = 0;
+
+  for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+    if (i < HISTOGRAM_BUCKETS - 1) {
+      out.printf("%s_bucket{%s%sle=\"%.3f\"} %lu\n", name, labels, separator,
+                 histogram.bounds[i] / 1000000.0, (unsigned long)cumulative);
+    } else {
+      out.printf("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, separator, (unsigned long)cumulative);
+    }
+  }
+
+  const char* open = labels[0] ? "{" : "";
+  const char* close = labels[0] ? "}" : "";
+  out.printf("%s_sum%s%s%s %.6f\n", name, open, labels, close,
+             histogram.sumUs.load(std::memory_order_relaxed) / 1000000.0);
+  out.printf("%s_count%s%s%s %lu\n", name, open, labels, close,
+             (unsigned long)histogram.count.load(std::memory_order_relaxed));
+}
+
+/**
+ * Print the whole registry in the Prometheus text format
+ * @param out Destination
+ */
+void printMetrics(Print& out) {
+  static const char* const WAKE_LABELS[] = {"power_on", "timer", "ext0", "ext1", "other"};
+
+  out.println("# TYPE gattaiola_wakeups_total counter");
+  for (uint8_t i = COUNTER_WAKE_POWER_ON; i <= COUNTER_WAKE_OTHER; i++) {
+    out.printf("gattaiola_wakeups_total{reason=\"%s\"} %lu\n", WAKE_LABELS[i],
+               (unsigned long)metricCounters[i].load(std::memory_order_relaxed));
+  }
+
+  out.println("# TYPE gattaiola_wake_stub_skipped_total counter");
+  out.printf("gattaiola_wake_stub_skipped_total %lu\n", (unsigned long)metricCounters[COUNTER_WAKE_STUB_SKIPPED].load());
+  out.println("# TYPE gattaiola_i2c_errors_total counter");
+  out.printf("gattaiola_i2c_errors_total %lu\n", (unsigned long)metricCounters[COUNTER_I2C_ERRORS].load());
+  out.println("# TYPE gattaiola_nvs_writes_total counter");
+  out.printf("gattaiola_nvs_writes_total %lu\n", (unsigned long)metricCounters[COUNTER_NVS_WRITES].load());
+  out.println("# TYPE gattaiola_wifi_connects_total counter");
+  out.printf("gattaiola_wifi_connects_total %lu\n", (unsigned long)metricCounters[COUNTER_WIFI_CONNECTS].load());
+  out.println("# TYPE gattaiola_wifi_failures_total counter");
+  out.printf("gattaiola_wifi_failures_total %lu\n", (unsigned long)metricCounters[COUNTER_WIFI_FAILURES].load());
+  out.println("# TYPE gattaiola_http_requests_total counter");
+  out.printf("gattaiola_http_requests_total %lu\n", (unsigned long)metricCounters[COUNTER_HTTP_REQUESTS].load());
+
+  out.println("# TYPE gattaiola_heap_free_bytes gauge");
+  out.printf("gattaiola_heap_free_bytes %lu\n", (unsigned long)ESP.getFreeHeap());
+  out.println("# TYPE gattaiola_heap_min_free_bytes gauge");
+  out.printf("gattaiola_heap_min_free_bytes %lu\n", (unsigned long)metricsMinFreeHeap());
+  out.println("# TYPE gattaiola_heap_largest_free_block_bytes gauge");
+  out.printf("gattaiola_heap_largest_free_block_bytes %lu\n", (unsigned long)ESP.getMaxAllocHeap());
+  out.println("# TYPE gattaiola_wake_handler_latency_seconds gauge");
+  out.printf("gattaiola_wake_handler_latency_seconds %.6f\n", metricWakeHandlerLatencyUs / 1e6);
+  out.println("# TYPE gattaiola_battery_volts gauge");
+  out.printf("gattaiola_battery_volts %.3f\n", metricBatteryMillivolts / 1000.0);
+  out.println("# TYPE gattaiola_wifi_tx_power_dbm gauge");
+  out.printf("gattaiola_wifi_tx_power_dbm %.2f\n", metricWiFiTxPowerQuarterDbm / 4.0);
+  out.println("# TYPE gattaiola_wifi_rssi_dbm gauge");
+  out.printf("gattaiola_wifi_rssi_dbm %d\n", metricWiFiRssi);
+  out.println("# TYPE gattaiola_uptime_seconds gauge");
+  out.printf("gattaiola_uptime_seconds %lu\n", (unsigned long)(millis() / 1000));
+
+  out.println("# TYPE gattaiola_wifi_connect_duration_seconds histogram");
+  printHistogram(out, "gattaiola_wifi_connect_duration_seconds", "", wifiConnectDuration);
+
+  out.println("# TYPE gattaiola_http_request_duration_seconds histogram");
+  char labels[40];
+  for (uint8_t i = 0; i < ROUTE_COUNT; i++) {
+    if (routeLatency[i].count.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    snprintf(labels, sizeof(labels), "route=\"%s\"", ROUTE_LABELS[i]);
+    printHistogram(out, "gattaiola_http_request_duration_seconds", labels, routeLatency[i]);
+  }
+}
+
+#endif // METRICS_H
@@ -1,23 +1,113 @@
 #ifndef RTC_H
 #define RTC_H
 
+/*
+ * DS3231 driver on the I2C bus manager
+ *
+ * All the registers the firmware needs (time, control, status with the
+ * oscillator stop flag, temperature) are read in a single burst of
+ * DS3231_REGISTER_COUNT bytes. The decoded result is cached and
+ * extrapolated with millis() for up to RTC_CACHE_VALIDITY_MS, so repeated
+ * time queries during a wake cost no bus transaction.
+ */
+
 #include <time.h>
 #include <RTClib.h>
-#include <Wire.h>
+#include "i2c_bus.h"
 #include "utilities.h"
+#include "metrics.h"
+#include "trace.h"
 
-// RTC DS3231 object
-RTC_DS3231 rtc;
+// Configuration constants
+const uint8_t DS3231_ADDRESS = 0x68;
+const uint8_t DS3231_REG_SECONDS = 0x00;      // Time registers 0x00-0x06, BCD
+const uint8_t DS3231_REG_CONTROL = 0x0E;
+const uint8_t DS3231_REG_STATUS = 0x0F;
+const uint8_t DS3231_REG_TEMPERATURE = 0x11;  // MSB integer part, 0x12 bits 7-6 quarters
+const uint8_t DS3231_REGISTER_COUNT = 0x13;   // 0x00-0x12 in one burst
+const uint8_t DS3231_STATUS_OSF = 0x80;       // Oscillator stopped, time invalid
+const uint32_t RTC_CACHE_VALIDITY_MS = 60000; // millis() drift stays well below 1 s
+const char* const LOCAL_TIMEZONE = "CET-1CEST,M3.5.0,M10.5.0/3";  // The RTC keeps UTC, POSIX rule of the local time
 
 // Global variables
 bool rtcFound = false;
 bool rtcTimeValid = false;
 DateTime rtcTime;
+uint32_t rtcTimeMillis = 0;  // millis() when rtcTime was read
+bool rtcCacheValid = false;  // rtcTime and the registers below come from the device
+uint8_t rtcControl = 0;
+uint8_t rtcStatus = 0;
+float rtcTemperature = 0;
+
+uint8_t bcdToBin(uint8_t value) {
+  return value - 6 * (value >> 4);
+}
+
+uint8_t binToBcd(uint8_t value) {
+  return value + 6 * (value / 10);
+}
+
+/**
+ * Read and decode all the DS3231 registers in one transaction
+ * @return true if the device answered
+ */
+bool readRTCRegisters() {
+  uint8_t registers[DS3231_REGISTER_COUNT];
+  bool success;
+  {
+    TRACE_ZONE("rtc.read");
+    success = i2cReadRegisters(DS3231_ADDRESS, DS3231_REG_SECONDS, registers, sizeof(registers));
+  }
+  if (!success) {
+    rtcCacheValid = false;
+    return false;
+  }
+
+  // Hours register: bit 6 selects the 12 hour mode, bit 5 is then PM
+  uint8_t hourRegister = registers[2];
+  uint8_t hour;
+  if (hourRegister & 0x40) {
+    hour = bcdToBin(hourRegister & 0x1F) % 12 + ((hourRegister & 0x20) ? 12 : 0);
+  } else {
+    hour = bcdToBin(hourRegister & 0x3F);
+  }
+
+  rtcTime = DateTime(2000 + bcdToBin(registers[6]), bcdToBin(registers[5] & 0x1F),
+                     bcdToBin(registers[4] & 0x3F), hour, bcdToBin(registers[1] & 0x7F),
+                     bcdToBin(registers[0] & 0x7F));
+  rtcTimeMillis = millis();
+  rtcControl = registers[DS3231_REG_CONTROL];
+  rtcStatus = registers[DS3231_REG_STATUS];
+  rtcTemperature = (int8_t)registers[DS3231_REG_TEMPERATURE] +
+                   (registers[DS3231_REG_TEMPERATURE + 1] >> 6) * 0.25f;
+  rtcCacheValid = true;
+  return true;
+}
+
+/**
+ * Make sure the cached registers are not older than maxAge
+ * @param maxAge Maximum age of the cache in milliseconds
+ * @return true if the cache holds a device reading
+ */
+bool refreshRTC(uint32_t maxAge = RTC_CACHE_VALIDITY_MS) {
+  if (rtcCacheValid && millis() - rtcTimeMillis < maxAge) {
+    return true;
+  }
+  return readRTCRegisters();
+}
+
+/**
+ * Current RTC time, from the cache when it is fresh enough
+ */
+DateTime rtcNow() {
+  refreshRTC();
+  return DateTime(rtcTime.unixtime() + (millis() - rtcTimeMillis) / 1000);
+}
 
 void initializeRTC() {
   Serial.println("Initializing RTC DS3231...");
   
-  if (!rtc.begin()) {
+  if (!readRTCRegisters()) {
     Serial.println("✗ Could not find RTC DS3231!");
     Serial.println("  Check wiring: SDA->GPIO21, SCL->GPIO22, VCC->3.3V, GND->GND");
     rtcFound = false;
@@ -28,7 +118,7 @@ void initializeRTC() {
   Serial.println("✓ RTC DS3231 found");
   
   // Check if RTC lost power
-  if (rtc.lostPower()) {
+  if (rtcStatus & DS3231_STATUS_OSF) {
     Serial.println("⚠ RTC lost power - time may be invalid");
     rtcTimeValid = false;
   } else {
@@ -36,9 +126,8 @@ void initializeRTC() {
   }
   
   // Display RTC info
-  float temperature = rtc.getTemperature();
   Serial.print("RTC Temperature: ");
-  Serial.print(temperature);
+  Serial.print(rtcTemperature);
   Serial.println("°C");
 }
 
@@ -49,24 +138,84 @@ bool checkRTCTime() {
   
   Serial.println("Checking RTC time validity...");
   
-  rtcTime = rtc.now();
+  // Served from the burst read of initializeRTC()
+  refreshRTC();
+  char buffer[DATE_TIME_BUFFER_SIZE];
   
   // Check if time is reasonable (after year 2020)
   if (rtcTime.year() >= 2020) {
     rtcTimeValid = true;
     Serial.println("✓ RTC time appears valid");
     Serial.print("RTC Time (UTC): ");
-    Serial.println(formatDateTime(rtcTime));
+    Serial.println(formatDateTime(rtcTime, buffer, sizeof(buffer)));
     return true;
   } else {
     rtcTimeValid = false;
     Serial.println("✗ RTC time appears invalid (year < 2020)");
     Serial.print("RTC Time: ");
-    Serial.println(formatDateTime(rtcTime));
+    Serial.println(formatDateTime(rtcTime, buffer, sizeof(buffer)));
     return false;
   }
 }
 
+/**
+ * Get the current Unix time without an I2C transaction
+ * Extrapolates the last RTC reading with millis()
+ * @return Unix time in seconds, 0 if the RTC time is not valid
+ */
+uint32_t currentUnixTime() {
+  if (!rtcTimeValid) {
+    return 0;
+  }
+  return rtcTime.unixtime() + (millis() - rtcTimeMillis) / 1000;
+}
+
+/**
+ * Install the local time zone rule for localtime_r() and mktime()
+ * The environment does not survive deep sleep: call on every boot
+ */
+void initializeTimezone() {
+  setenv("TZ", LOCAL_TIMEZONE, 1);
+  tzset();
+}
+
+/**
+ * Local calendar time, daylight saving time included
+ * @param utc Unix time in seconds
+ * @param local Filled with the broken down local time
+ */
+void localTimeOf(uint32_t utc, struct tm& local) {
+  time_t time = utc;
+  localtime_r(&time, &local);
+}
+
+/**
+ * Next time the local clock shows the given hour and minute
+ * Goes through mktime() so 23 and 25 hour DST days are handled
+ * @param utc Unix time in seconds to start from
+ * @param hour Local hour (0-23)
+ * @param minute Local minute (0-59)
+ * @return Unix time in seconds, at or after utc
+ */
+uint32_t nextLocalTime(uint32_t utc, uint8_t hour, uint8_t minute) {
+  struct tm local;
+  localTimeOf(utc, local);
+  int today = local.tm_mday;
+  time_t next;
+  for (int day = 0; day < 2; day++) {
+    local.tm_mday = today + day;
+    local.tm_hour = hour;
+    local.tm_min = minute;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    next = mktime(&local);
+    if (next >= (time_t)utc) {
+      break;
+    }
+  }
+  return next;
+}
+
 // Optional: Function to manually set RTC time (useful for testing)
 void setRTCTime(int year, int month, int day, int hour, int minute, int second) {
   if (!rtcFound) {
@@ -75,10 +224,28 @@ void setRTCTime(int year, int month, int day, int hour, int minute, int second)
   }
   
   DateTime newTime(year, month, day, hour, minute, second);
-  rtc.adjust(newTime);
+
+  // Day of week register counts 1-7, Sunday is 7
+  uint8_t dayOfWeek = newTime.dayOfTheWeek();
+  uint8_t registers[7] = {
+    binToBcd(newTime.second()), binToBcd(newTime.minute()), binToBcd(newTime.hour()),
+    binToBcd(dayOfWeek == 0 ? 7 : dayOfWeek), binToBcd(newTime.day()),
+    binToBcd(newTime.month()), binToBcd(newTime.year() - 2000)
+  };
+  uint8_t status = rtcStatus & ~DS3231_STATUS_OSF;  // Time is valid again
+  if (!i2cWriteRegisters(DS3231_ADDRESS, DS3231_REG_SECONDS, registers, sizeof(registers)) ||
+      !i2cWriteRegisters(DS3231_ADDRESS, DS3231_REG_STATUS, &status, 1)) {
+    Serial.println("✗ Could not write RTC time");
+    return;
+  }
+  rtcTime = newTime;
+  rtcTimeMillis = millis();
+  rtcStatus = status;
+  rtcCacheValid = true;
   
+  char buffer[DATE_TIME_BUFFER_SIZE];
   Serial.println("RTC time manually set to:");
-  Serial.println(formatDateTime(newTime));
+  Serial.println(formatDateTime(newTime, buffer, sizeof(buffer)));
   
   rtcTimeValid = true;
 }
@@ -0,0 +1,269 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+/*
+ * On-device self-test
+ *
+ * Times the operations that dominate a wake cycle on this unit, so that
+ * a field unit with a poor battery life can be compared with a good one:
+ * - DS3231 burst read over the I2C bus
+ * - Preferences (NVS) read and write
+ * - raw flash read throughput (running application partition)
+ * - heap allocation
+ * - WiFi scan and connection, when the station is not serving the page
+ *
+ * Unlike the benchmarks (benchmark.h), the self-test is always built and
+ * runs on demand: GET /api/selftest, or 's' on serial. The report is a JSON
+ * document with the percentiles of each test, printed on serial between
+ * SELFTEST_BEGIN and SELFTEST_END markers. The suite blocks for a few
+ * seconds, mostly in the WiFi tests.
+ */
+
+#include <Preferences.h>
+#include <ArduinoJson.h>
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include "rtc.h"
+#include "wifi.h"
+#include "metrics.h"
+#include "utilities.h"
+
+// Configuration constants
+const uint16_t SELFTEST_MAX_SAMPLES = 32;     // Samples kept per test
+const uint16_t SELFTEST_FAST_ITERATIONS = 20; // I2C, NVS reads, flash, heap
+const uint16_t SELFTEST_NVS_WRITES = 10;      // Each one writes flash
+const uint16_t SELFTEST_WIFI_ITERATIONS = 2;  // Up to seconds per sample
+const size_t SELFTEST_FLASH_READ_SIZE = 64 * 1024;
+const size_t SELFTEST_FLASH_BLOCK_SIZE = 4096;
+const uint16_t SELFTEST_HEAP_ALLOCATIONS = 100; // Per sample
+const size_t SELFTEST_HEAP_BLOCK_SIZE = 256;
+
+// Global variables
+uint32_t selfTestSamples[SELFTEST_MAX_SAMPLES];
+
+/**
+ * Time a function, one sample per call
+ * @param iterations Number of calls (at most SELFTEST_MAX_SAMPLES)
+ * @param fn Function under test, returns false on failure
+ * @param errors Incremented for each failed call
+ * @return Number of samples taken
+ */
+template <typename Function>
+uint16_t timeSelfTest(uint16_t iterations, uint16_t& errors, Function fn) {
+  iterations = min(iterations, SELFTEST_MAX_SAMPLES);
+  for (uint16_t i = 0; i < iterations; i++) {
+    int64_t start = esp_timer_get_time();
+    if (!fn()) {
+      errors++;
+    }
+    selfTestSamples[i] = (uint32_t)(esp_timer_get_time() - start);
+  }
+  return iterations;
+}
+
+/**
+ * Add a test entry with the statistics of selfTestSamples to the report
+ * @param tests Report array
+ * @param name Test name
+ * @param unit Unit of the samples
+ * @param count Number of samples
+ * @param errors Failed calls
+ */
+void addSelfTestResult(JsonArray tests, const char* name, const char* unit, uint16_t count, uint16_t errors) {
+  uint64_t total = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    total += selfTestSamples[i];
+  }
+
+  JsonObject test = tests.add<JsonObject>();
+  test["name"] = name;
+  test["unit"] = unit;
+  test["samples"] = count;
+  test["errors"] = errors;
+  test["mean"] = count > 0 ? (uint32_t)(total / count) : 0;
+  test["p50"] = computePercentile(selfTestSamples, count, 50);
+  test["p90"] = computePercentile(selfTestSamples, count, 90);
+  test["max"] = count > 0 ? selfTestSamples[count - 1] : 0;
+}
+
+/**
+ * Add a test that could not run to the report
+ */
+void addSelfTestSkipped(JsonArray tests, const char* name, const char* reason) {
+  JsonObject test = tests.add<JsonObject>();
+  test["name"] = name;
+  test["skipped"] = reason;
+}
+
+void selfTestRTC(JsonArray tests) {
+  uint16_t errors = 0;
+  uint16_t count = timeSelfTest(SELFTEST_FAST_ITERATIONS, errors, []() {
+    uint8_t registers[DS3231_REGISTER_COUNT];
+    return i2cReadRegisters(DS3231_ADDRESS, DS3231_REG_SECONDS, registers, sizeof(registers));
+  });
+  addSelfTestResult(tests, "ds3231_burst_read", "us", count, errors);
+}
+
+void selfTestNVS(JsonArray tests) {
+  // Separate namespace, the configuration is never touched
+  Preferences selfTestPrefs;
+  if (!selfTestPrefs.begin("selftest", false)) {
+    addSelfTestSkipped(tests, "nvs_read", "namespace not available");
+    addSelfTestSkipped(tests, "nvs_write", "namespace not available");
+    return;
+  }
+
+  selfTestPrefs.putUInt("value", 0);
+
+  uint16_t errors = 0;
+  uint16_t count = timeSelfTest(SELFTEST_FAST_ITERATIONS, errors, [&selfTestPrefs]() {
+    return selfTestPrefs.getUInt("value", UINT32_MAX) != UINT32_MAX;
+  });
+  addSelfTestResult(tests, "nvs_read", "us", count, errors);
+
+  // A new value each time, NVS skips writes of an unchanged value
+  uint32_t value = 0;
+  errors = 0;
+  count = timeSelfTest(SELFTEST_NVS_WRITES, errors, [&selfTestPrefs, &value]() {
+    return selfTestPrefs.putUInt("value", ++value) == sizeof(value);
+  });
+  addSelfTestResult(tests, "nvs_write", "us", count, errors);
+
+  selfTestPrefs.clear();
+  selfTestPrefs.end();
+  metricIncrement(COUNTER_NVS_WRITES, 2 + count);
+}
+
+void selfTestFlash(JsonArray tests) {
+  const esp_partition_t* partition = esp_ota_get_running_partition();
+  if (partition == nullptr || partition->size < SELFTEST_FLASH_READ_SIZE) {
+    addSelfTestSkipped(tests, "flash_read", "no partition");
+    return;
+  }
+
+  // Raw reads through the SPI driver, not the instruction cache
+  static uint8_t block[SELFTEST_FLASH_BLOCK_SIZE];
+  uint16_t errors = 0;
+  uint16_t count = timeSelfTest(SELFTEST_FAST_ITERATIONS, errors, [partition]() {
+    for (size_t offset = 0; offset < SELFTEST_FLASH_READ_SIZE; offset += sizeof(block)) {
+      if (esp_partition_read(partition, offset, block, sizeof(block)) != ESP_OK) {
+        return false;
+      }
+    }
+    return true;
+  });
+
+  // Report throughput rather than time
+  for (uint16_t i = 0; i < count; i++) {
+    selfTestSamples[i] = selfTestSamples[i] > 0 ? SELFTEST_FLASH_READ_SIZE * 1000 / selfTestSamples[i] : 0;
+  }
+  addSelfTestResult(tests, "flash_read", "KB/s", count, errors);
+}
+
+void selfTestHeap(JsonArray tests) {
+  uint16_t errors = 0;
+  uint16_t count = timeSelfTest(SELFTEST_FAST_ITERATIONS, errors, []() {
+    bool success = true;
+    for (uint16_t i = 0; i < SELFTEST_HEAP_ALLOCATIONS; i++) {
+      void* volatile block = malloc(SELFTEST_HEAP_BLOCK_SIZE);  // volatile: keep the pair
+      success = success && (block != nullptr);
+      free(block);
+    }
+    return success;
+  });
+
+  // One sample covers SELFTEST_HEAP_ALLOCATIONS malloc/free pairs
+  for (uint16_t i = 0; i < count; i++) {
+    selfTestSamples[i] = selfTestSamples[i] * 1000 / SELFTEST_HEAP_ALLOCATIONS;
+  }
+  addSelfTestResult(tests, "heap_malloc_free_256", "ns", count, errors);
+}
+
+void selfTestWiFi(JsonArray tests) {
+  // The page is served by the access point, switching channel would drop the client
+  if (WiFi.getMode() == WIFI_AP || WiFi.getMode() == WIFI_AP_STA) {
+    addSelfTestSkipped(tests, "wifi_scan", "access point active");
+    addSelfTestSkipped(tests, "wifi_connect", "access point active");
+    return;
+  }
+
+  bool wasStopped = (currentWiFiState == WIFI_STOPPED);
+  WiFi.mode(WIFI_STA);
+
+  uint16_t errors = 0;
+  uint16_t count = timeSelfTest(SELFTEST_WIFI_ITERATIONS, errors, []() {
+    int16_t found = WiFi.scanNetworks();
+    WiFi.scanDelete();
+    return found >= 0;
+  });
+  for (uint16_t i = 0; i < count; i++) {
+    selfTestSamples[i] /= 1000;
+  }
+  addSelfTestResult(tests, "wifi_scan", "ms", count, errors);
+
+  // Full association and DHCP on the first candidate network, at full power
+  loadWiFiCandidates();
+  const WiFiNetwork& network = *wifiCandidates[0];
+  errors = 0;
+  count = timeSelfTest(SELFTEST_WIFI_ITERATIONS, errors, [&network]() {
+    WiFi.disconnect();
+    prepareLink(0);
+    WiFi.begin(network.ssid, network.password);
+    uint32_t start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < CONNECTION_TIMEOUT) {
+      delay(10);
+    }
+    return WiFi.status() == WL_CONNECTED;
+  });
+  for (uint16_t i = 0; i < count; i++) {
+    selfTestSamples[i] /= 1000;
+  }
+  addSelfTestResult(tests, "wifi_connect", "ms", count, errors);
+
+  // Leave the radio as it was, a running state machine resumes on its own
+  if (wasStopped) {
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+  } else {
+    forceReconnection();
+  }
+}
+
+/**
+ * Run the whole suite
+ * @param report Destination document
+ */
+void runSelfTest(JsonDocument& report) {
+  Serial.println("Running self-test...");
+
+  report["cpuMhz"] = ESP.getCpuFreqMHz();
+  report["freeHeap"] = ESP.getFreeHeap();
+  report["uptime"] = millis() / 1000;
+  report["bootCount"] = lifetimeCounter(LIFETIME_BOOTS);
+
+  JsonArray tests = report["tests"].to<JsonArray>();
+  selfTestRTC(tests);
+  selfTestNVS(tests);
+  selfTestFlash(tests);
+  selfTestHeap(tests);
+  selfTestWiFi(tests);
+}
+
+/**
+ * Run the self-test and print the report on the 's' command
+ * @param command Character received on serial, from loop()
+ */
+void handleSelfTestCommand(char command) {
+  if (command == 's') {
+    JsonDocument report;
+    runSelfTest(report);
+
+    Serial.println("SELFTEST_BEGIN");
+    serializeJsonPretty(report, Serial);
+    Serial.println();
+    Serial.println("SELFTEST_END");
+  }
+}
+
+#endif // SELFTEST_H
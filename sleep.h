@@ -4,10 +4,20 @@
 #include <WiFi.h>
 #include <esp_sleep.h>
 #include <driver/rtc_io.h>
+#include "board.h"
+#include "metrics.h"
+#include "lifetime.h"
+#include "sleep_calibration.h"
+#include "wake_stub.h"
+#include "telemetry.h"
 
 // Configuration constants
-#define WAKE_PIN GPIO_NUM_0        // GPIO0 (BOOT button) for external wake
-#define WAKE_PIN_LEVEL 0           // Wake when pin goes LOW (button pressed)
+// External wake pins come from the board table (PIN_WAKE_LOW / PIN_WAKE_HIGH)
+typedef SleepPinMasks<Board> WakePins;
+
+// The ESP32 EXT1 source only wakes on ANY_HIGH or ALL_LOW: active-high pins
+// share EXT1, a single active-low pin can use EXT0
+static_assert(__builtin_popcountll(WakePins::WAKE_LOW) <= 1, "Only one active-low wake pin (EXT0) is supported");
 
 // Sleep duration in microseconds (1 second = 1,000,000 microseconds)
 // #define SLEEP_TIME_10_SEC    10000000      // 10 seconds
@@ -15,11 +25,9 @@
 // #define SLEEP_TIME_5_MIN     300000000     // 5 minutes
 // #define SLEEP_TIME_1_HOUR    3600000000    // 1 hour
 
-// Wake up reasons
-RTC_DATA_ATTR int bootCount = 0;  // Variable stored in RTC memory
-
 void configureWakeSources(uint64_t sleepDuration, bool enableTimerWake, bool enableExternalWake);
 void configureGPIOForSleep();
+uint64_t configureWakePins();
 esp_sleep_wakeup_cause_t getWakeupReason();
 void displaySleepInfo(uint64_t sleepDuration, bool enableTimerWake, bool enableExternalWake);
 
@@ -31,6 +39,9 @@ void displaySleepInfo(uint64_t sleepDuration, bool enableTimerWake, bool enableE
  */
 void enterDeepSleep(uint64_t sleepDuration, bool enableTimerWake, bool enableExternalWake) {
   Serial.println("\n=== PREPARING FOR DEEP SLEEP ===");
+
+  // Record how long this wake lasted, with the RSSI while still connected
+  telemetryBeforeSleep();
   
   // Clean up WiFi connection to save power
   if (WiFi.status() == WL_CONNECTED) {
@@ -48,6 +59,9 @@ void enterDeepSleep(uint64_t sleepDuration, bool enableTimerWake, bool enableExt
   // Display sleep info
   displaySleepInfo(sleepDuration, enableTimerWake, enableExternalWake);
   
+  // Keep counters across the sleep
+  metricsBeforeSleep();
+  
   // Final message
   Serial.println("Entering deep sleep NOW...");
   Serial.flush(); // Make sure all serial output is sent
@@ -62,27 +76,52 @@ void enterDeepSleep(uint64_t sleepDuration, bool enableTimerWake, bool enableExt
 void configureWakeSources(uint64_t sleepDuration, bool enableTimerWake, bool enableExternalWake) {
   // Configure timer wake up
   if (enableTimerWake && sleepDuration > 0) {
-    esp_sleep_enable_timer_wakeup(sleepDuration);
+    // Compensate the RC oscillator drift measured against the DS3231
+    uint64_t timerDuration = startSleepCalibration(sleepDuration);
+    esp_sleep_enable_timer_wakeup(timerDuration);
     Serial.print("Timer wake up enabled for ");
     Serial.print(sleepDuration / 1000000);
-    Serial.println(" seconds");
+    Serial.print(" seconds (timer ");
+    Serial.print(timerDuration);
+    Serial.println(" us)");
   }
   
-  // Configure external wake up (EXT0 - single pin)
+  // Configure external wake up (EXT0 active-low pin, EXT1 active-high pins)
   if (enableExternalWake) {
-    // Enable wake up from external pin
-    esp_sleep_enable_ext0_wakeup(WAKE_PIN, WAKE_PIN_LEVEL);
-    
+    uint64_t ext1Mask = configureWakePins();
+    Serial.printf("External wake up enabled: EXT0 mask 0x%llx (LOW), EXT1 mask 0x%llx (ANY HIGH)\n",
+                  (unsigned long long)WakePins::WAKE_LOW, (unsigned long long)ext1Mask);
+  }
+}
+
+/**
+ * Arm the external wake sources from the board table
+ * @return Pins armed on EXT1
+ */
+uint64_t configureWakePins() {
+  if (WakePins::WAKE_LOW) {
+    gpio_num_t pin = (gpio_num_t)__builtin_ctzll(WakePins::WAKE_LOW);
+    esp_sleep_enable_ext0_wakeup(pin, 0);
+
     // Configure the pin as RTC GPIO to work during sleep
-    rtc_gpio_pullup_en(WAKE_PIN);
-    rtc_gpio_pulldown_dis(WAKE_PIN);
-    
-    Serial.print("External wake up enabled on GPIO");
-    Serial.print(WAKE_PIN);
-    Serial.print(" (wake when ");
-    Serial.print(WAKE_PIN_LEVEL ? "HIGH" : "LOW");
-    Serial.println(")");
+    rtc_gpio_pullup_en(pin);
+    rtc_gpio_pulldown_dis(pin);
+  }
+
+  // A pin already high would wake the chip at once (cat standing in the beam)
+  uint64_t ext1Mask = 0;
+  for (uint64_t mask = WakePins::WAKE_HIGH; mask != 0; mask &= mask - 1) {
+    uint8_t pin = __builtin_ctzll(mask);
+    if (digitalRead(pin) == HIGH) {
+      Serial.printf("⚠ GPIO%u already high, not armed for wake\n", pin);
+    } else {
+      ext1Mask |= 1ULL << pin;
+    }
+  }
+  if (ext1Mask) {
+    esp_sleep_enable_ext1_wakeup(ext1Mask, ESP_EXT1_WAKEUP_ANY_HIGH);
   }
+  return ext1Mask;
 }
 
 /**
@@ -91,23 +130,8 @@ void configureWakeSources(uint64_t sleepDuration, bool enableTimerWake, bool ena
 void configureGPIOForSleep() {
   Serial.println("Configuring GPIOs for low power...");
   
-  // Isolate all GPIOs except wake pin to reduce power consumption
-  // Note: This will disable all GPIOs, use carefully!
-  
-  // Example: Set unused pins as input with pullup to avoid floating
-  for (int i = 0; i <= 39; i++) {
-    if (i != WAKE_PIN) {  // Don't modify wake pin
-      // Skip pins that can't be used as regular GPIO
-      if (i == 6 || i == 7 || i == 8 || i == 9 || i == 10 || i == 11) {
-        continue; // These are connected to flash
-      }
-      if (i >= 34 && i <= 39) {
-        pinMode(i, INPUT); // Input only pins
-      } else {
-        pinMode(i, INPUT_PULLUP);
-      }
-    }
-  }
+  // Pin states come from the board table, masks are computed at compile time
+  applySleepPinConfiguration<Board>();
 }
 
 /**
@@ -146,7 +170,7 @@ esp_sleep_wakeup_cause_t getWakeupReason() {
 void displaySleepInfo(uint64_t sleepDuration, bool enableTimerWake, bool enableExternalWake) {
   Serial.println("\n--- SLEEP CONFIGURATION ---");
   Serial.print("Boot count: ");
-  Serial.println(bootCount);
+  Serial.println(lifetimeCounter(LIFETIME_BOOTS));
   
   if (enableTimerWake && sleepDuration > 0) {
     Serial.print("Timer wake: ");
@@ -157,9 +181,7 @@ void displaySleepInfo(uint64_t sleepDuration, bool enableTimerWake, bool enableE
   }
   
   if (enableExternalWake) {
-    Serial.print("External wake: GPIO");
-    Serial.print(WAKE_PIN);
-    Serial.println(" enabled");
+    Serial.println("External wake: enabled");
   } else {
     Serial.println("External wake: DISABLED");
   }
@@ -206,32 +228,7 @@ bool shouldEnterSleep() {
   // - User input
   
   // Simple example: sleep if boot count is multiple of 3
-  return (bootCount % 3 == 0);
-}
-
-// Advanced: Sleep with multiple external pins (EXT1)
-void sleepWithMultiplePins() {
-  Serial.println("Configuring wake up from multiple pins...");
-  
-  // Define which pins can wake up the ESP32 (bitmask)
-  uint64_t ext_wakeup_pin_1_mask = (1ULL << GPIO_NUM_0);  // GPIO0
-  uint64_t ext_wakeup_pin_2_mask = (1ULL << GPIO_NUM_2);  // GPIO2
-  uint64_t wakeup_pin_mask = ext_wakeup_pin_1_mask | ext_wakeup_pin_2_mask;
-  
-  // Configure pins as RTC GPIOs
-  rtc_gpio_pullup_en(GPIO_NUM_0);
-  rtc_gpio_pullup_en(GPIO_NUM_2);
-  rtc_gpio_pulldown_dis(GPIO_NUM_0);
-  rtc_gpio_pulldown_dis(GPIO_NUM_2);
-  
-  // Enable wake up from multiple pins (wake when ANY pin goes LOW)
-  esp_sleep_enable_ext1_wakeup(wakeup_pin_mask, ESP_EXT1_WAKEUP_ALL_LOW);
-  
-  Serial.println("Wake up enabled on GPIO0 and GPIO2");
-  Serial.println("ESP32 will wake when BOTH pins are LOW");
-  
-  Serial.flush();
-  esp_deep_sleep_start();
+  return (lifetimeCounter(LIFETIME_BOOTS) % 3 == 0);
 }
 
 #endif // SLEEP_H
\ No newline at end of file
@@ -0,0 +1,139 @@
+#ifndef SLEEP_CALIBRATION_H
+#define SLEEP_CALIBRATION_H
+
+/*
+ * Deep sleep timer calibration
+ *
+ * The sleep timer runs from the internal 150 kHz RC oscillator, which
+ * drifts by several percent with temperature. Every full boot after a timer
+ * wake compares the time actually spent asleep, measured with the DS3231,
+ * with the time that was requested. The relative error is kept per
+ * temperature bin (DS3231 sensor) in RTC memory and the next sleep duration
+ * is corrected with the entry matching the current temperature.
+ *
+ * The timer period actually programmed already includes the correction, so
+ * the error measured against it is the whole timer error and is averaged
+ * into the table as is.
+ *
+ * The DS3231 resolution is one second: sleeps shorter than
+ * SLEEP_CAL_MIN_SAMPLE_MS (wakes absorbed by the wake stub included) are
+ * not measured, the others are averaged, and measurements obviously wrong
+ * (RTC adjusted in the meantime) are discarded. The time from the wake to
+ * the start of the application (ROM, bootloader) is not visible to
+ * millis() and is subtracted as SLEEP_CAL_BOOT_MS.
+ */
+
+#include <esp_sleep.h>
+#include "rtc.h"
+
+// Configuration constants
+const int8_t SLEEP_CAL_MIN_TEMPERATURE = -20;    // Lower edge of the first bin (°C)
+const uint8_t SLEEP_CAL_BIN_WIDTH = 5;           // °C per bin
+const uint8_t SLEEP_CAL_BIN_COUNT = 18;          // -20°C to 70°C
+const int32_t SLEEP_CAL_MAX_ERROR_PPM = 100000;  // Beyond 10% the measurement is discarded
+const uint8_t SLEEP_CAL_AVERAGE_WEIGHT = 4;      // New samples weigh 1/4 in the average
+const int64_t SLEEP_CAL_MIN_SAMPLE_MS = 300000;  // 1 s RTC resolution: +-3300 ppm at 5 minutes
+const int64_t SLEEP_CAL_BOOT_MS = 250;           // Wake to application start, measured on the board
+
+// Correction table, kept across deep sleep
+RTC_DATA_ATTR int32_t sleepCalibrationPpm[SLEEP_CAL_BIN_COUNT];      // Actual vs requested duration
+RTC_DATA_ATTR uint8_t sleepCalibrationSamples[SLEEP_CAL_BIN_COUNT];  // Saturates at 255
+
+// Last sleep, recorded at sleep entry
+RTC_DATA_ATTR uint64_t sleepStartUnixMs = 0;  // RTC time when sleep started, 0 if unknown
+RTC_DATA_ATTR uint64_t sleepRequestedUs = 0;  // Timer period actually programmed, correction included
+
+/**
+ * Temperature bin for a DS3231 reading
+ */
+uint8_t sleepCalibrationBin(float temperature) {
+  int bin = (int)floorf((temperature - SLEEP_CAL_MIN_TEMPERATURE) / SLEEP_CAL_BIN_WIDTH);
+  return constrain(bin, 0, SLEEP_CAL_BIN_COUNT - 1);
+}
+
+/**
+ * Current RTC time in milliseconds, extrapolated from the cached reading
+ */
+uint64_t rtcUnixMillis() {
+  return (uint64_t)rtcTime.unixtime() * 1000 + (millis() - rtcTimeMillis);
+}
+
+/**
+ * Correction for the current temperature
+ * Falls back to the closest calibrated bin, 0 if none is calibrated yet
+ * @return Relative error of the sleep timer in ppm (positive = sleeps longer)
+ */
+int32_t sleepCalibrationError() {
+  int bin = sleepCalibrationBin(rtcTemperature);
+  for (int distance = 0; distance < SLEEP_CAL_BIN_COUNT; distance++) {
+    if (bin - distance >= 0 && sleepCalibrationSamples[bin - distance] > 0) {
+      return sleepCalibrationPpm[bin - distance];
+    }
+    if (bin + distance < SLEEP_CAL_BIN_COUNT && sleepCalibrationSamples[bin + distance] > 0) {
+      return sleepCalibrationPpm[bin + distance];
+    }
+  }
+  return 0;
+}
+
+/**
+ * Timer period to program so that the sleep lasts the requested time
+ * @param sleepDuration Wanted duration in microseconds
+ */
+uint64_t calibratedSleepDuration(uint64_t sleepDuration) {
+  return sleepDuration * 1000000ULL / (1000000LL + sleepCalibrationError());
+}
+
+/**
+ * Record the start of a timer sleep, called right before entering it
+ * @param sleepDuration Wanted duration in microseconds
+ * @return Timer period to program
+ */
+uint64_t startSleepCalibration(uint64_t sleepDuration) {
+  sleepRequestedUs = calibratedSleepDuration(sleepDuration);
+  sleepStartUnixMs = rtcTimeValid ? rtcUnixMillis() : 0;
+  return sleepRequestedUs;
+}
+
+/**
+ * Measure the last sleep and update the table
+ * Called once per boot, after the RTC has been read
+ * @param wakeReason Wake cause of this boot, only timer wakes are measured
+ * @param skippedWakes Timer wakes absorbed by the wake stub during the sleep
+ */
+void updateSleepCalibration(esp_sleep_wakeup_cause_t wakeReason, uint32_t skippedWakes) {
+  uint64_t startMs = sleepStartUnixMs;
+  sleepStartUnixMs = 0;
+
+  if (wakeReason != ESP_SLEEP_WAKEUP_TIMER || startMs == 0 || !rtcTimeValid || sleepRequestedUs == 0) {
+    return;
+  }
+
+  // Neither the boot nor the time since the application started are part of the sleep
+  int64_t sleptMs = (int64_t)(rtcUnixMillis() - millis()) - SLEEP_CAL_BOOT_MS - (int64_t)startMs;
+  int64_t requestedMs = sleepRequestedUs * (skippedWakes + 1) / 1000;
+  if (requestedMs < SLEEP_CAL_MIN_SAMPLE_MS) {
+    return;  // Too short for the RTC resolution
+  }
+  int32_t errorPpm = (int32_t)((sleptMs - requestedMs) * 1000000LL / requestedMs);
+
+  if (abs(errorPpm) > SLEEP_CAL_MAX_ERROR_PPM) {
+    Serial.println("⚠ Sleep calibration sample discarded");
+    return;
+  }
+
+  uint8_t bin = sleepCalibrationBin(rtcTemperature);
+  if (sleepCalibrationSamples[bin] == 0) {
+    sleepCalibrationPpm[bin] = errorPpm;
+  } else {
+    sleepCalibrationPpm[bin] += (errorPpm - sleepCalibrationPpm[bin]) / SLEEP_CAL_AVERAGE_WEIGHT;
+  }
+  if (sleepCalibrationSamples[bin] < UINT8_MAX) {
+    sleepCalibrationSamples[bin]++;
+  }
+
+  Serial.printf("Sleep calibration: requested %lld ms, slept %lld ms, %.1f°C -> %ld ppm\n",
+                (long long)requestedMs, (long long)sleptMs, rtcTemperature, (long)sleepCalibrationPpm[bin]);
+}
+
+#endif // SLEEP_CALIBRATION_H
@@ -0,0 +1,112 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+ * RTC memory state snapshot
+ *
+ * Before deep sleep the state that is expensive to rebuild is copied to a
+ * single structure in RTC slow memory, protected by a version and a CRC:
+ * RTC validity, the configuration (otherwise read key by key from NVS), the
+ * WiFi access point cache and link quality, and the schedule state.
+ *
+ * On a deep sleep wake restoreSnapshot() copies it back in a few
+ * microseconds and setup() skips the RTC validation and the NVS reads. The
+ * state is rebuilt from scratch on power-on reset, on a firmware with a
+ * different SNAPSHOT_VERSION or on CRC mismatch (RTC memory corrupted by a
+ * brown-out).
+ */
+
+#include <esp_rom_crc.h>
+#include <esp_sleep.h>
+#include "rtc.h"
+#include "sleep.h"
+#include "wifi.h"
+#include "web_server.h"
+
+// Configuration constants
+const uint32_t SNAPSHOT_VERSION = 3;  // Increment when SystemSnapshot changes
+
+/**
+ * State kept across deep sleep
+ * Plain data only, the CRC covers every byte before the crc field
+ */
+struct SystemSnapshot {
+  uint32_t version;
+  bool rtcFound;
+  bool rtcTimeValid;
+  bool actionExecutedToday;
+  uint8_t wifiNetwork;
+  int32_t wifiChannel;
+  uint8_t wifiBssid[6];
+  int8_t wifiLinkRssi[MAX_WIFI_CANDIDATES];
+  uint32_t configHash;   // CRC of config, logs configuration changes
+  SystemConfig config;
+  uint32_t crc;
+};
+
+static_assert(std::is_trivially_copyable<SystemSnapshot>::value, "SystemSnapshot must stay plain data");
+
+// Global variables
+RTC_DATA_ATTR SystemSnapshot snapshot;
+
+uint32_t computeSnapshotCrc(const SystemSnapshot& data) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&data, offsetof(SystemSnapshot, crc));
+}
+
+uint32_t computeConfigHash() {
+  return esp_rom_crc32_le(0, (const uint8_t*)&config, sizeof(config));
+}
+
+/**
+ * Restore the state saved before deep sleep
+ * @param wakeReason Wake cause of this boot
+ * @return true if the state was restored, false if it must be rebuilt
+ */
+bool restoreSnapshot(esp_sleep_wakeup_cause_t wakeReason) {
+  if (wakeReason == ESP_SLEEP_WAKEUP_UNDEFINED) {
+    return false;  // Power-on: RTC memory content is meaningless
+  }
+  if (snapshot.version != SNAPSHOT_VERSION || snapshot.crc != computeSnapshotCrc(snapshot)) {
+    Serial.println("⚠ RTC snapshot invalid, rebuilding state");
+    return false;
+  }
+
+  rtcFound = snapshot.rtcFound;
+  rtcTimeValid = snapshot.rtcTimeValid;
+  actionExecutedToday = snapshot.actionExecutedToday;
+  wifiCachedNetwork = snapshot.wifiNetwork;
+  wifiCachedChannel = snapshot.wifiChannel;
+  memcpy(wifiCachedBssid, snapshot.wifiBssid, sizeof(wifiCachedBssid));
+  memcpy(wifiLinkRssi, snapshot.wifiLinkRssi, sizeof(wifiLinkRssi));
+  memcpy(&config, &snapshot.config, sizeof(config));
+
+  Serial.println("✓ State restored from RTC snapshot");
+  return true;
+}
+
+/**
+ * Save the state to RTC memory, called right before deep sleep
+ */
+void captureSnapshot() {
+  uint32_t previousConfigHash = snapshot.configHash;
+
+  // Clear the padding too, it is covered by the CRC
+  memset((void*)&snapshot, 0, sizeof(snapshot));
+  snapshot.version = SNAPSHOT_VERSION;
+  snapshot.rtcFound = rtcFound;
+  snapshot.rtcTimeValid = rtcTimeValid;
+  snapshot.actionExecutedToday = actionExecutedToday;
+  snapshot.wifiNetwork = wifiCachedNetwork;
+  snapshot.wifiChannel = wifiCachedChannel;
+  memcpy(snapshot.wifiBssid, wifiCachedBssid, sizeof(snapshot.wifiBssid));
+  memcpy(snapshot.wifiLinkRssi, wifiLinkRssi, sizeof(snapshot.wifiLinkRssi));
+  memcpy(&snapshot.config, &config, sizeof(snapshot.config));
+  snapshot.configHash = computeConfigHash();
+  snapshot.crc = computeSnapshotCrc(snapshot);
+
+  if (snapshot.configHash != previousConfigHash) {
+    Serial.println("Configuration changed, RTC snapshot updated");
+  }
+}
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,272 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Per-cat daily statistics
+ *
+ * Entries, exits, rejected passages and time spent outside are added up
+ * per cat and per day as each door event is dispatched, so reading them
+ * (/api/stats) costs the same whatever the number of events.
+ *
+ * Days are kept in a ring of STATS_DAYS buckets indexed by local day
+ * number (the RTC keeps UTC, see localTimeOf()), each tagged with its day.
+ * An event goes to the bucket of its own timestamp: a bucket holding an
+ * older day is reset, an event older than the ring is only used for the
+ * last seen time. There is no midnight timer to miss during deep sleep,
+ * and a time sync moving the clock back or forward simply addresses other
+ * buckets. Time outside spanning midnight is split between the days.
+ *
+ * The state lives in RTC memory and is saved to NVS when a new day starts
+ * and while the battery is low, then reloaded on power-on.
+ */
+
+#include <Preferences.h>
+#include <ArduinoJson.h>
+#include <esp_rom_crc.h>
+#include <esp_sleep.h>
+#include "events.h"
+#include "metrics.h"
+#include "rtc.h"
+
+// Configuration constants
+const uint8_t STATS_MAX_CATS = 4;          // Subjects 1-3, 0 collects unidentified cats
+const uint8_t STATS_DAYS = 7;
+const uint32_t SECONDS_PER_DAY = 86400;
+const uint32_t STATS_VERSION = 1;          // Increment when StatsState changes
+
+/**
+ * Activity of one cat during one day
+ */
+struct CatDayStats {
+  uint16_t entries;
+  uint16_t exits;
+  uint16_t rejected;
+  uint32_t secondsOutside;
+};
+
+struct DayStats {
+  uint32_t day;                            // Day number, 0 = bucket unused
+  CatDayStats cats[STATS_MAX_CATS];
+};
+
+/**
+ * Current whereabouts of one cat
+ */
+struct CatState {
+  uint32_t lastSeen;                       // Last passage of any kind, 0 = never
+  uint32_t outsideSince;                   // Exit time, 0 = inside or unknown
+};
+
+struct StatsState {
+  uint32_t version;
+  DayStats days[STATS_DAYS];
+  CatState cats[STATS_MAX_CATS];
+  uint32_t crc;
+};
+
+// Global variables
+RTC_DATA_ATTR StatsState stats;
+bool statsDirty = false;                   // Changed since last saved to NVS
+
+uint32_t computeStatsCrc(const StatsState& state) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&state, offsetof(StatsState, crc));
+}
+
+/**
+ * Local day number of an RTC (UTC) time
+ * @return Days from 1970-01-01 to the local date
+ */
+uint32_t statsDayOf(uint32_t time) {
+  struct tm local;
+  localTimeOf(time, local);
+  int year = local.tm_year + 1900;
+  int leapDays = (year - 1969) / 4 - (year - 1901) / 100 + (year - 1601) / 400;
+  return (year - 1970) * 365 + leapDays + local.tm_yday;
+}
+
+/**
+ * Local midnight starting a day, as an RTC (UTC) time
+ * mktime() applies the DST rule: days are 23 or 25 hours long when it changes
+ */
+uint32_t statsDayStart(uint32_t day) {
+  struct tm local = {};
+  local.tm_year = 70;
+  local.tm_mday = 1 + day;
+  local.tm_isdst = -1;
+  return mktime(&local);
+}
+
+/**
+ * Bucket of a day, reset if it holds an older day
+ * @return nullptr if the day is older than the ring
+ */
+DayStats* statsDay(uint32_t day, bool& newDay) {
+  DayStats& bucket = stats.days[day % STATS_DAYS];
+  newDay = false;
+  if (bucket.day == day) {
+    return &bucket;
+  }
+  if (bucket.day > day) {
+    return nullptr;
+  }
+  memset(&bucket, 0, sizeof(bucket));
+  bucket.day = day;
+  newDay = true;
+  return &bucket;
+}
+
+/**
+ * Save the state to NVS
+ */
+void saveStats() {
+  Preferences statsPrefs;
+  statsPrefs.begin("stats", false);
+  stats.crc = computeStatsCrc(stats);
+  statsPrefs.putBytes("state", &stats, sizeof(stats));
+  statsPrefs.end();
+  metricIncrement(COUNTER_NVS_WRITES);
+  statsDirty = false;
+}
+
+/**
+ * Reload the state on power-on, RTC memory keeps it across deep sleep
+ * @param wakeReason Wake cause of this boot
+ */
+void initializeStats(esp_sleep_wakeup_cause_t wakeReason) {
+  if (wakeReason != ESP_SLEEP_WAKEUP_UNDEFINED && stats.version == STATS_VERSION) {
+    return;
+  }
+
+  Preferences statsPrefs;
+  statsPrefs.begin("stats", true);
+  size_t length = statsPrefs.getBytes("state", &stats, sizeof(stats));
+  statsPrefs.end();
+
+  if (length != sizeof(stats) || stats.version != STATS_VERSION || stats.crc != computeStatsCrc(stats)) {
+    memset((void*)&stats, 0, sizeof(stats));
+    stats.version = STATS_VERSION;
+    Serial.println("Cat statistics started");
+  } else {
+    Serial.println("✓ Cat statistics restored");
+  }
+}
+
+/**
+ * Add a time outside, split over the days it spans
+ */
+void addTimeOutside(uint8_t cat, uint32_t from, uint32_t to) {
+  // Days older than the ring are dropped, do not walk through them
+  if (to - from > STATS_DAYS * SECONDS_PER_DAY) {
+    from = to - STATS_DAYS * SECONDS_PER_DAY;
+  }
+
+  while (from < to) {
+    uint32_t day = statsDayOf(from);
+    uint32_t end = min(to, statsDayStart(day + 1));
+    bool newDay;
+    DayStats* bucket = statsDay(day, newDay);
+    if (bucket != nullptr) {
+      bucket->cats[cat].secondsOutside += end - from;
+    }
+    from = end;
+  }
+}
+
+/**
+ * Update the statistics with a dispatched event
+ * @param event Door event, other types are ignored
+ */
+void updateStats(const Event& event) {
+  if (event.timestamp == 0 ||
+      (event.type != EVENT_DOOR_ENTRY && event.type != EVENT_DOOR_EXIT && event.type != EVENT_DOOR_REJECTED)) {
+    return;  // No valid time, or not a passage
+  }
+
+  uint8_t cat = (event.subject < STATS_MAX_CATS) ? event.subject : 0;
+  CatState& state = stats.cats[cat];
+  state.lastSeen = max(state.lastSeen, event.timestamp);
+
+  bool newDay;
+  DayStats* bucket = statsDay(statsDayOf(event.timestamp), newDay);
+  if (bucket != nullptr) {
+    CatDayStats& day = bucket->cats[cat];
+    switch (event.type) {
+      case EVENT_DOOR_ENTRY: day.entries++; break;
+      case EVENT_DOOR_EXIT: day.exits++; break;
+      default: day.rejected++; break;
+    }
+  }
+
+  if (event.type == EVENT_DOOR_EXIT) {
+    state.outsideSince = event.timestamp;
+  } else if (event.type == EVENT_DOOR_ENTRY) {
+    if (state.outsideSince != 0 && event.timestamp > state.outsideSince) {
+      addTimeOutside(cat, state.outsideSince, event.timestamp);
+    }
+    state.outsideSince = 0;
+  }
+
+  statsDirty = true;
+  if (newDay) {
+    saveStats();  // Once a day: yesterday is complete
+  }
+}
+
+/**
+ * Save pending changes while the battery is low, called from loop()
+ */
+void handleStats(bool batteryLow) {
+  if (statsDirty && batteryLow) {
+    saveStats();
+  }
+}
+
+/**
+ * Fill the statistics reported by GET /api/stats
+ * The days are listed newest first, only those in use
+ * @param object Destination object
+ * @param now Current RTC time, counts the ongoing time outside
+ */
+void buildStatsJson(JsonObject object, uint32_t now) {
+  JsonArray cats = object["cats"].to<JsonArray>();
+  uint32_t today = statsDayOf(now);
+
+  for (uint8_t cat = 0; cat < STATS_MAX_CATS; cat++) {
+    const CatState& state = stats.cats[cat];
+    if (state.lastSeen == 0) {
+      continue;
+    }
+
+    JsonObject catObject = cats.add<JsonObject>();
+    catObject["id"] = cat;
+    catObject["lastSeen"] = state.lastSeen;
+    catObject["outside"] = (state.outsideSince != 0);
+
+    JsonArray days = catObject["days"].to<JsonArray>();
+    for (uint8_t age = 0; age < STATS_DAYS; age++) {
+      uint32_t day = today - age;
+      const DayStats& bucket = stats.days[day % STATS_DAYS];
+      if (bucket.day != day) {
+        continue;
+      }
+
+      const CatDayStats& dayStats = bucket.cats[cat];
+      uint32_t secondsOutside = dayStats.secondsOutside;
+      if (state.outsideSince != 0 && now > state.outsideSince) {
+        // Still outside: count the part of the ongoing absence in this day
+        uint32_t start = max(state.outsideSince, statsDayStart(day));
+        uint32_t end = min(now, statsDayStart(day + 1));
+        secondsOutside += (end > start) ? end - start : 0;
+      }
+
+      JsonObject dayObject = days.add<JsonObject>();
+      dayObject["day"] = statsDayStart(day);  // Local midnight, Unix time
+      dayObject["entries"] = dayStats.entries;
+      dayObject["exits"] = dayStats.exits;
+      dayObject["rejected"] = dayStats.rejected;
+      dayObject["secondsOutside"] = secondsOutside;
+    }
+  }
+}
+
+#endif // STATS_H
@@ -0,0 +1,120 @@
+#ifndef STATUS_LED_H
+#define STATUS_LED_H
+
+/*
+ * Status LED patterns
+ *
+ * The LED is driven by a LEDC low speed channel clocked from the internal
+ * 8 MHz RC oscillator: once a pattern is set the peripheral blinks on its
+ * own, with no loop() polling, and keeps running during light sleep.
+ *
+ * Each status is a blink frequency and duty cycle. Several statuses can be
+ * active at once, the LED shows the one with the highest priority (lowest
+ * LedStatus value). setLedStatus() is the only call needed, it returns at
+ * once and does nothing if the displayed pattern does not change.
+ */
+
+#include <driver/ledc.h>
+#include "board.h"
+
+// Configuration constants
+const uint8_t STATUS_LED_PIN = Board::LED_PIN;
+const ledc_mode_t STATUS_LED_LEDC_MODE = LEDC_LOW_SPEED_MODE;  // Only low speed runs from RC_FAST
+const ledc_timer_t STATUS_LED_LEDC_TIMER = LEDC_TIMER_1;
+const ledc_channel_t STATUS_LED_LEDC_CHANNEL = LEDC_CHANNEL_1;
+const ledc_timer_bit_t STATUS_LED_RESOLUTION = LEDC_TIMER_13_BIT;  // Reaches 1 Hz from 8 MHz
+const uint32_t STATUS_LED_MAX_DUTY = (1 << 13) - 1;
+
+/**
+ * Statuses shown by the LED, highest priority first
+ */
+enum LedStatus : uint8_t {
+  LED_STATUS_RTC_ERROR,
+  LED_STATUS_LOW_BATTERY,
+  LED_STATUS_AP_MODE,
+  LED_STATUS_WIFI_CONNECTING,
+  LED_STATUS_COUNT
+};
+
+struct LedPattern {
+  uint32_t frequencyHz;
+  uint8_t dutyPercent;
+};
+
+const LedPattern LED_PATTERNS[LED_STATUS_COUNT] = {
+  {2, 50},  // RTC error: regular 2 Hz blink
+  {1, 5},   // Low battery: short flash every second
+  {1, 90},  // Access point: mostly on, short dark gap
+  {5, 50},  // WiFi connecting: fast blink
+};
+
+// Global variables
+uint8_t ledStatusMask = 0;         // Active statuses
+int8_t ledShownStatus = -1;        // Status currently played, -1 = LED off
+
+const char* getLedStatusString(int8_t status) {
+  switch (status) {
+    case LED_STATUS_RTC_ERROR: return "RTC_ERROR";
+    case LED_STATUS_LOW_BATTERY: return "LOW_BATTERY";
+    case LED_STATUS_AP_MODE: return "AP_MODE";
+    case LED_STATUS_WIFI_CONNECTING: return "WIFI_CONNECTING";
+    default: return "OFF";
+  }
+}
+
+/**
+ * Configure the LEDC timer and channel, LED off
+ */
+void initializeStatusLed() {
+  ledc_timer_config_t timerConfig = {};
+  timerConfig.speed_mode = STATUS_LED_LEDC_MODE;
+  timerConfig.duty_resolution = STATUS_LED_RESOLUTION;
+  timerConfig.timer_num = STATUS_LED_LEDC_TIMER;
+  timerConfig.freq_hz = LED_PATTERNS[0].frequencyHz;
+  timerConfig.clk_cfg = LEDC_USE_RC_FAST_CLK;
+  ledc_timer_config(&timerConfig);
+
+  ledc_channel_config_t channelConfig = {};
+  channelConfig.gpio_num = STATUS_LED_PIN;
+  channelConfig.speed_mode = STATUS_LED_LEDC_MODE;
+  channelConfig.channel = STATUS_LED_LEDC_CHANNEL;
+  channelConfig.intr_type = LEDC_INTR_DISABLE;
+  channelConfig.timer_sel = STATUS_LED_LEDC_TIMER;
+  channelConfig.duty = 0;
+  channelConfig.hpoint = 0;
+  channelConfig.sleep_mode = LEDC_SLEEP_MODE_KEEP_ALIVE;  // Keep blinking in light sleep
+  ledc_channel_config(&channelConfig);
+}
+
+/**
+ * Turn a status on or off and update the pattern
+ * @param status Status to change
+ * @param active true to show it
+ */
+void setLedStatus(LedStatus status, bool active) {
+  uint8_t mask = active ? (ledStatusMask | (1 << status)) : (ledStatusMask & ~(1 << status));
+  if (mask == ledStatusMask) {
+    return;
+  }
+  ledStatusMask = mask;
+
+  int8_t shown = (mask != 0) ? __builtin_ctz(mask) : -1;
+  if (shown == ledShownStatus) {
+    return;
+  }
+  ledShownStatus = shown;
+
+  if (shown < 0) {
+    ledc_stop(STATUS_LED_LEDC_MODE, STATUS_LED_LEDC_CHANNEL, 0);
+  } else {
+    const LedPattern& pattern = LED_PATTERNS[shown];
+    ledc_set_freq(STATUS_LED_LEDC_MODE, STATUS_LED_LEDC_TIMER, pattern.frequencyHz);
+    ledc_set_duty(STATUS_LED_LEDC_MODE, STATUS_LED_LEDC_CHANNEL, STATUS_LED_MAX_DUTY * pattern.dutyPercent / 100);
+    ledc_update_duty(STATUS_LED_LEDC_MODE, STATUS_LED_LEDC_CHANNEL);
+  }
+
+  Serial.print("Status LED: ");
+  Serial.println(getLedStatusString(shown));
+}
+
+#endif // STATUS_LED_H
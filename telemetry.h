@@ -0,0 +1,523 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/*
+ * Telemetry recorder and history
+ *
+ * While the unit is awake, a sample is taken every
+ * TELEMETRY_SAMPLE_INTERVAL_S: DS3231 temperature, battery voltage and the
+ * WiFi RSSI when connected. One more sample is taken before deep sleep
+ * with the duration of the wake.
+ *
+ * Samples are delta encoded into a ring of blocks in RTC memory. A record
+ * is a flags byte followed by the varint time delta when it is not the
+ * nominal interval, and by a zigzag varint delta for each field that
+ * changed (temperature, battery) or was sampled (RSSI, wake duration).
+ * Battery changes within TELEMETRY_BATTERY_DEADBAND_MV are treated as no
+ * change, so a steady sample takes one byte and the 3.5 KB ring holds more
+ * than a day of 1-minute samples. Each block starts from zero values, so
+ * the oldest block can be dropped without breaking the deltas.
+ *
+ * Every TELEMETRY_COMPACT_WINDOW_S window is compacted into the telemetry
+ * stream of the event journal as the minimum and the maximum of each field,
+ * so the ring never needs to hold more than the windows not compacted yet.
+ *
+ * GET /api/history returns one series downsampled on the device: the time
+ * range is split into buckets and each bucket gives its minimum and its
+ * maximum, in time order, so spikes survive the reduction (the passage
+ * activity gives a count per bucket instead). The journal is read once,
+ * through the sparse index, followed by the samples still in the ring, and
+ * the points are streamed as each bucket is closed: RAM use is one bucket
+ * and the response never exceeds HISTORY_MAX_POINTS points, whatever the
+ * range.
+ */
+
+#include <algorithm>
+#include <WiFi.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include "rtc.h"
+#include "battery.h"
+#include "events.h"
+#include "journal.h"
+
+// Configuration constants
+const uint32_t TELEMETRY_SAMPLE_INTERVAL_S = 60;
+const uint32_t TELEMETRY_COMPACT_WINDOW_S = 900;
+const int32_t TELEMETRY_BATTERY_DEADBAND_MV = 10;   // Below the ADC noise
+const uint8_t TELEMETRY_BLOCKS = 14;
+const uint16_t TELEMETRY_BLOCK_SIZE = 256;
+const uint8_t TELEMETRY_MAX_RECORD_SIZE = 1 + 5 * 5;  // Flags, time and 4 fields as 32-bit varints
+const uint16_t HISTORY_DEFAULT_POINTS = 200;
+const uint16_t HISTORY_MAX_POINTS = 400;
+const uint32_t HISTORY_DEFAULT_RANGE_S = 7 * 86400UL;
+
+// Record flags: which values follow the flags byte
+enum TelemetryField : uint8_t {
+  TELEMETRY_TEMPERATURE = 0x01,  // Changed
+  TELEMETRY_BATTERY = 0x02,      // Changed
+  TELEMETRY_RSSI = 0x04,         // Sampled, delta from the last RSSI of the block
+  TELEMETRY_WAKE = 0x08,         // Sampled, delta from the last wake duration of the block
+  TELEMETRY_TIME = 0x10          // Time delta, otherwise TELEMETRY_SAMPLE_INTERVAL_S
+};
+
+enum HistorySeries : uint8_t {
+  HISTORY_TEMPERATURE,
+  HISTORY_BATTERY,
+  HISTORY_RSSI,
+  HISTORY_WAKE,
+  HISTORY_ACTIVITY,       // Door entries and exits, from the journal only
+  HISTORY_NONE
+};
+
+const uint8_t TELEMETRY_SERIES_COUNT = HISTORY_ACTIVITY;  // Series recorded in the ring
+
+/**
+ * Decoded sample, also the delta reference while encoding and decoding
+ */
+struct TelemetrySample {
+  uint32_t timestamp;
+  int32_t temperature;    // 0.25 °C
+  int32_t battery;        // mV
+  int32_t rssi;           // dBm
+  int32_t wakeMs;
+  uint8_t fields;         // Flags of the record, tells whether rssi and wakeMs were sampled
+};
+
+/**
+ * Sample ring in RTC memory, cleared on power-on
+ */
+struct TelemetryRing {
+  uint8_t data[TELEMETRY_BLOCKS][TELEMETRY_BLOCK_SIZE];
+  uint16_t length[TELEMETRY_BLOCKS];  // Bytes used, 0 = empty
+  uint8_t head;                       // Block receiving the records
+  TelemetrySample last;               // Reference after the last record of the head block
+  uint32_t compactedUntil;            // Samples before this time are in the journal
+};
+
+/**
+ * Samples falling in one bucket
+ */
+struct HistoryBucket {
+  uint32_t index;
+  uint16_t count;
+  uint32_t minTime;
+  uint32_t maxTime;
+  int16_t minValue;
+  int16_t maxValue;
+};
+
+// Global variables
+RTC_DATA_ATTR TelemetryRing telemetry;
+
+uint8_t* writeVarint(uint8_t* out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+const uint8_t* readVarint(const uint8_t* in, uint32_t& value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    uint8_t byte = *in++;
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+  return in;
+}
+
+inline uint32_t zigzagEncode(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * Encode a sample as a record
+ * @param sample Sample, its fields say whether rssi and wakeMs are present
+ * @param reference Delta reference, updated as the decoder will
+ * @param out Destination, at least TELEMETRY_MAX_RECORD_SIZE bytes
+ * @return Record size
+ */
+size_t encodeTelemetrySample(const TelemetrySample& sample, TelemetrySample& reference, uint8_t* out) {
+  uint8_t flags = sample.fields & (TELEMETRY_RSSI | TELEMETRY_WAKE);
+  if (sample.temperature != reference.temperature) flags |= TELEMETRY_TEMPERATURE;
+  if (sample.battery != reference.battery) flags |= TELEMETRY_BATTERY;
+  if (sample.timestamp - reference.timestamp != TELEMETRY_SAMPLE_INTERVAL_S) flags |= TELEMETRY_TIME;
+
+  uint8_t* end = out;
+  *end++ = flags;
+  if (flags & TELEMETRY_TIME) end = writeVarint(end, sample.timestamp - reference.timestamp);
+  if (flags & TELEMETRY_TEMPERATURE) end = writeVarint(end, zigzagEncode(sample.temperature - reference.temperature));
+  if (flags & TELEMETRY_BATTERY) end = writeVarint(end, zigzagEncode(sample.battery - reference.battery));
+  if (flags & TELEMETRY_RSSI) end = writeVarint(end, zigzagEncode(sample.rssi - reference.rssi));
+  if (flags & TELEMETRY_WAKE) end = writeVarint(end, zigzagEncode(sample.wakeMs - reference.wakeMs));
+
+  reference.timestamp = sample.timestamp;
+  reference.temperature = sample.temperature;
+  reference.battery = sample.battery;
+  if (flags & TELEMETRY_RSSI) reference.rssi = sample.rssi;
+  if (flags & TELEMETRY_WAKE) reference.wakeMs = sample.wakeMs;
+  reference.fields = flags;
+  return end - out;
+}
+
+/**
+ * Decode a record
+ * @param in Start of the record
+ * @param sample Previous sample of the block (zero for the first record), replaced by the record
+ * @return Start of the next record
+ */
+const uint8_t* decodeTelemetrySample(const uint8_t* in, TelemetrySample& sample) {
+  uint8_t flags = *in++;
+  uint32_t value;
+  if (flags & TELEMETRY_TIME) {
+    in = readVarint(in, value);
+    sample.timestamp += value;
+  } else {
+    sample.timestamp += TELEMETRY_SAMPLE_INTERVAL_S;
+  }
+  if (flags & TELEMETRY_TEMPERATURE) { in = readVarint(in, value); sample.temperature += zigzagDecode(value); }
+  if (flags & TELEMETRY_BATTERY) { in = readVarint(in, value); sample.battery += zigzagDecode(value); }
+  if (flags & TELEMETRY_RSSI) { in = readVarint(in, value); sample.rssi += zigzagDecode(value); }
+  if (flags & TELEMETRY_WAKE) { in = readVarint(in, value); sample.wakeMs += zigzagDecode(value); }
+  sample.fields = flags;
+  return in;
+}
+
+/**
+ * Visit the samples of the ring, oldest first
+ * @param visit Called with each TelemetrySample
+ */
+template <typename Visitor>
+void forEachTelemetrySample(Visitor visit) {
+  for (uint8_t n = 1; n <= TELEMETRY_BLOCKS; n++) {
+    uint8_t block = (telemetry.head + n) % TELEMETRY_BLOCKS;
+    const uint8_t* in = telemetry.data[block];
+    const uint8_t* end = in + telemetry.length[block];
+    TelemetrySample sample = {};
+    while (in < end) {
+      in = decodeTelemetrySample(in, sample);
+      visit(sample);
+    }
+  }
+}
+
+/**
+ * Value of a series in a sample, in the unit of its journal events
+ * @return false if the sample does not hold the series
+ */
+bool getTelemetryValue(const TelemetrySample& sample, HistorySeries series, int16_t& value) {
+  switch (series) {
+    case HISTORY_TEMPERATURE: value = sample.temperature; return true;
+    case HISTORY_BATTERY: value = (int16_t)min(sample.battery, (int32_t)INT16_MAX); return true;
+    case HISTORY_RSSI: value = sample.rssi; return (sample.fields & TELEMETRY_RSSI) != 0;
+    case HISTORY_WAKE: value = (int16_t)min(sample.wakeMs / 10, (int32_t)INT16_MAX); return (sample.fields & TELEMETRY_WAKE) != 0;
+    default: return false;
+  }
+}
+
+EventType getHistoryEventType(HistorySeries series) {
+  switch (series) {
+    case HISTORY_TEMPERATURE: return EVENT_TEMPERATURE;
+    case HISTORY_BATTERY: return EVENT_BATTERY;
+    case HISTORY_RSSI: return EVENT_WIFI_RSSI;
+    case HISTORY_WAKE: return EVENT_WAKE_DURATION;
+    default: return EVENT_NONE;
+  }
+}
+
+/**
+ * Add a value to a bucket
+ */
+void addToBucket(HistoryBucket& bucket, uint32_t time, int16_t value) {
+  if (bucket.count == 0 || value < bucket.minValue) {
+    bucket.minValue = value;
+    bucket.minTime = time;
+  }
+  if (bucket.count == 0 || value > bucket.maxValue) {
+    bucket.maxValue = value;
+    bucket.maxTime = time;
+  }
+  bucket.count = min(bucket.count + 1, (int)UINT16_MAX);
+}
+
+/**
+ * Emit the minimum and the maximum of a bucket in time order, once if they
+ * are the same sample, and empty it
+ * @param emit Called with (time, value)
+ */
+template <typename Emitter>
+void flushBucket(HistoryBucket& bucket, Emitter emit) {
+  if (bucket.count == 0) {
+    return;
+  }
+  if (bucket.minTime <= bucket.maxTime) {
+    emit(bucket.minTime, bucket.minValue);
+    if (bucket.maxTime != bucket.minTime) {
+      emit(bucket.maxTime, bucket.maxValue);
+    }
+  } else {
+    emit(bucket.maxTime, bucket.maxValue);
+    emit(bucket.minTime, bucket.minValue);
+  }
+  bucket.count = 0;
+}
+
+/**
+ * Clear the ring on power-on, RTC memory keeps it across deep sleep
+ * @param wakeReason Wake cause of this boot
+ */
+void initializeTelemetry(esp_sleep_wakeup_cause_t wakeReason) {
+  if (wakeReason == ESP_SLEEP_WAKEUP_UNDEFINED) {
+    memset(&telemetry, 0, sizeof(telemetry));
+  }
+}
+
+/**
+ * Append a sample to the ring, dropping the oldest block when it is full
+ * @param now RTC time of the sample
+ * @param wakeMs Duration of the wake, 0 if not sampled
+ */
+void recordTelemetrySample(uint32_t now, uint32_t wakeMs) {
+  TelemetrySample sample = {};
+  sample.timestamp = now;
+  sample.temperature = refreshRTC() ? (int32_t)lroundf(rtcTemperature * 4) : telemetry.last.temperature;
+  sample.battery = batteryMillivolts;
+  if (abs(sample.battery - telemetry.last.battery) < TELEMETRY_BATTERY_DEADBAND_MV) {
+    sample.battery = telemetry.last.battery;
+  }
+  if (WiFi.status() == WL_CONNECTED) {
+    sample.rssi = WiFi.RSSI();
+    sample.fields |= TELEMETRY_RSSI;
+  }
+  if (wakeMs > 0) {
+    sample.wakeMs = wakeMs;
+    sample.fields |= TELEMETRY_WAKE;
+  }
+
+  uint8_t record[TELEMETRY_MAX_RECORD_SIZE];
+  TelemetrySample reference = telemetry.last;
+  size_t length = encodeTelemetrySample(sample, reference, record);
+  if (telemetry.length[telemetry.head] + length > TELEMETRY_BLOCK_SIZE) {
+    // New block from zero values, replacing the oldest one
+    telemetry.head = (telemetry.head + 1) % TELEMETRY_BLOCKS;
+    telemetry.length[telemetry.head] = 0;
+    reference = {};
+    length = encodeTelemetrySample(sample, reference, record);
+  }
+
+  memcpy(&telemetry.data[telemetry.head][telemetry.length[telemetry.head]], record, length);
+  telemetry.length[telemetry.head] += length;
+  telemetry.last = reference;
+}
+
+/**
+ * Append the minimum and maximum of each series of a window to the
+ * telemetry stream of the journal, in time order, and empty the buckets
+ */
+void appendTelemetryWindow(HistoryBucket* buckets) {
+  Event records[2 * TELEMETRY_SERIES_COUNT];
+  uint8_t count = 0;
+  for (uint8_t series = 0; series < TELEMETRY_SERIES_COUNT; series++) {
+    flushBucket(buckets[series], [&](uint32_t time, int16_t value) {
+      records[count++] = {time, getHistoryEventType((HistorySeries)series), 0, value};
+    });
+  }
+  std::sort(records, records + count, [](const Event& a, const Event& b) { return a.timestamp < b.timestamp; });
+  for (uint8_t i = 0; i < count; i++) {
+    appendJournalEvent(records[i], JOURNAL_TELEMETRY);
+  }
+}
+
+/**
+ * Append the minimum and maximum of each series over each complete window
+ * not compacted yet to the journal
+ * Windows are appended oldest first, each in time order, so the telemetry
+ * stream stays sorted for the journal binary search
+ * @param now RTC time
+ */
+void compactTelemetry(uint32_t now) {
+  uint32_t windowStart = now - now % TELEMETRY_COMPACT_WINDOW_S;
+  if (now < telemetry.compactedUntil) {
+    telemetry.compactedUntil = windowStart;  // Clock set back: start over from here
+  }
+  if (windowStart <= telemetry.compactedUntil) {
+    return;
+  }
+
+  HistoryBucket buckets[TELEMETRY_SERIES_COUNT] = {};
+  uint32_t currentWindow = 0;
+
+  forEachTelemetrySample([&](const TelemetrySample& sample) {
+    if (sample.timestamp < telemetry.compactedUntil || sample.timestamp >= windowStart) {
+      return;
+    }
+    uint32_t window = sample.timestamp / TELEMETRY_COMPACT_WINDOW_S;
+    if (window != currentWindow) {
+      appendTelemetryWindow(buckets);
+      currentWindow = window;
+    }
+    for (uint8_t series = 0; series < TELEMETRY_SERIES_COUNT; series++) {
+      int16_t value;
+      if (getTelemetryValue(sample, (HistorySeries)series, value)) {
+        addToBucket(buckets[series], sample.timestamp, value);
+      }
+    }
+  });
+  appendTelemetryWindow(buckets);
+
+  telemetry.compactedUntil = windowStart;
+}
+
+/**
+ * Sample at the interval and compact complete windows, called from loop()
+ */
+void handleTelemetry() {
+  uint32_t now = currentUnixTime();
+  if (now == 0) {
+    return;  // No valid time to stamp the samples with
+  }
+  // A clock set back restarts the interval
+  uint32_t lastSample = telemetry.last.timestamp;
+  if (lastSample == 0 || now < lastSample || now - lastSample >= TELEMETRY_SAMPLE_INTERVAL_S) {
+    recordTelemetrySample(now, 0);
+  }
+  compactTelemetry(now);
+}
+
+/**
+ * Record the duration of this wake, called before deep sleep
+ */
+void telemetryBeforeSleep() {
+  uint32_t now = currentUnixTime();
+  if (now != 0) {
+    recordTelemetrySample(now, (uint32_t)(esp_timer_get_time() / 1000));
+  }
+}
+
+const char* getHistorySeriesString(HistorySeries series) {
+  switch (series) {
+    case HISTORY_TEMPERATURE: return "temperature";
+    case HISTORY_BATTERY: return "battery";
+    case HISTORY_RSSI: return "rssi";
+    case HISTORY_WAKE: return "wake";
+    case HISTORY_ACTIVITY: return "activity";
+    default: return "none";
+  }
+}
+
+/**
+ * Series from its name, as used in /api/history
+ * @return HISTORY_NONE if the name is unknown
+ */
+HistorySeries getHistorySeriesFromString(const char* name) {
+  for (uint8_t i = 0; i < HISTORY_NONE; i++) {
+    if (strcmp(name, getHistorySeriesString((HistorySeries)i)) == 0) {
+      return (HistorySeries)i;
+    }
+  }
+  return HISTORY_NONE;
+}
+
+const char* getHistoryUnitString(HistorySeries series) {
+  switch (series) {
+    case HISTORY_TEMPERATURE: return "C";
+    case HISTORY_BATTERY: return "V";
+    case HISTORY_RSSI: return "dBm";
+    case HISTORY_WAKE: return "s";
+    default: return "passages";
+  }
+}
+
+/**
+ * Print one [time, value] point, the value in the unit of the series
+ */
+void printHistoryPoint(Print& out, HistorySeries series, bool first, uint32_t time, int32_t value) {
+  out.printf("%s[%lu,", first ? "" : ",", (unsigned long)time);
+  switch (series) {
+    case HISTORY_TEMPERATURE: out.printf("%.2f]", value / 4.0); break;
+    case HISTORY_BATTERY: out.printf("%.3f]", value / 1000.0); break;
+    case HISTORY_WAKE: out.printf("%.2f]", value / 100.0); break;
+    default: out.printf("%ld]", (long)value); break;
+  }
+}
+
+/**
+ * Stream a downsampled series as a JSON object
+ * @param out Destination
+ * @param series Series to read from the journal and the ring
+ * @param from Start of the range, Unix seconds inclusive
+ * @param to End of the range, Unix seconds inclusive
+ * @param points Maximum number of points, at most HISTORY_MAX_POINTS
+ */
+void printHistory(Print& out, HistorySeries series, uint32_t from, uint32_t to, uint16_t points) {
+  bool activity = (series == HISTORY_ACTIVITY);
+  uint32_t buckets = max(1, activity ? points : points / 2);  // Two points per min/max bucket
+  uint64_t span = (uint64_t)to - from + 1;
+
+  JournalQuery query;
+  query.from = from;
+  query.to = to;
+  query.type = activity ? -1 : getHistoryEventType(series);
+  query.limit = UINT16_MAX;  // Bounded by the journal capacity
+  query.stream = activity ? JOURNAL_EVENTS : JOURNAL_TELEMETRY;
+
+  out.printf("{\"series\":\"%s\",\"unit\":\"%s\",\"from\":%lu,\"to\":%lu,\"points\":[",
+             getHistorySeriesString(series), getHistoryUnitString(series),
+             (unsigned long)from, (unsigned long)to);
+
+  HistoryBucket bucket = {};
+  uint16_t printed = 0;
+  auto emit = [&](uint32_t time, int32_t value) {
+    if (printed < points) {  // A bucket reopened by out of order records must not exceed the bound
+      printHistoryPoint(out, series, printed++ == 0, time, value);
+    }
+  };
+  auto flush = [&]() {
+    if (activity && bucket.count > 0) {
+      emit(from + (uint32_t)(bucket.index * span / buckets), bucket.count);
+      bucket.count = 0;
+    } else {
+      flushBucket(bucket, emit);
+    }
+  };
+  // Records come in time order, except in the rare segment written across a clock change
+  auto add = [&](uint32_t time, int16_t value) {
+    uint32_t index = (uint32_t)((uint64_t)(time - from) * buckets / span);
+    if (index != bucket.index) {
+      flush();
+      bucket.index = index;
+    }
+    addToBucket(bucket, time, value);
+  };
+
+  queryJournal(query, [&](const Event& event) {
+    if (!activity || event.type == EVENT_DOOR_ENTRY || event.type == EVENT_DOOR_EXIT) {
+      add(event.timestamp, event.value);
+    }
+  });
+
+  // Then the samples not compacted yet, all newer than the journal ones
+  if (!activity) {
+    forEachTelemetrySample([&](const TelemetrySample& sample) {
+      int16_t value;
+      if (sample.timestamp >= telemetry.compactedUntil && sample.timestamp >= from && sample.timestamp <= to &&
+          getTelemetryValue(sample, series, value)) {
+        add(sample.timestamp, value);
+      }
+    });
+  }
+  flush();
+
+  out.printf("],\"count\":%u,\"scanned\":%lu}", printed, (unsigned long)journalRecordsRead);
+}
+
+#endif // TELEMETRY_H
@@ -0,0 +1,118 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Scoped cycle-counter tracer
+ *
+ * Enabled by defining ENABLE_TRACING before this header is included,
+ * otherwise TRACE_ZONE() expands to nothing and no code or data is
+ * generated.
+ *
+ * TRACE_ZONE("name") opens a zone that lasts until the end of the enclosing
+ * block. The zone reads the CPU cycle counter when it opens and closes and
+ * stores one fixed-size record in a preallocated ring buffer (the oldest
+ * records are overwritten). The buffer is exported in the Chrome trace-event
+ * JSON format, which can be opened in Perfetto (ui.perfetto.dev):
+ * - over serial, by sending 't' (see handleTraceCommand())
+ * - over HTTP, on GET /api/trace
+ *
+ * Timestamps assume a fixed CPU frequency, as configured by the Arduino core.
+ */
+
+#ifdef ENABLE_TRACING
+
+#include <atomic>
+
+// Configuration constants
+const uint32_t TRACE_BUFFER_SIZE = 512;  // Records, must be a power of two
+
+/**
+ * One completed zone
+ */
+struct TraceRecord {
+  const char* name;        // Zone name (string literal)
+  uint32_t startCycles;    // Cycle counter when the zone opened
+  uint32_t durationCycles; // Cycles spent in the zone
+  uint8_t core;            // CPU core that ran the zone
+};
+
+// Global variables
+TraceRecord traceBuffer[TRACE_BUFFER_SIZE];
+std::atomic<uint32_t> traceHead(0);  // Total number of records written
+
+/**
+ * RAII zone: records its lifetime in the trace buffer
+ */
+class TraceZone {
+ public:
+  explicit TraceZone(const char* name) : name_(name), start_(ESP.getCycleCount()) {}
+
+  ~TraceZone() {
+    uint32_t duration = ESP.getCycleCount() - start_;
+    uint32_t index = traceHead.fetch_add(1, std::memory_order_relaxed) & (TRACE_BUFFER_SIZE - 1);
+    TraceRecord& record = traceBuffer[index];
+    record.name = name_;
+    record.startCycles = start_;
+    record.durationCycles = duration;
+    record.core = xPortGetCoreID();
+  }
+
+ private:
+  const char* name_;
+  uint32_t start_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+
+/**
+ * Print the buffered records as Chrome trace-event JSON
+ * Records are printed oldest first. The 32-bit cycle counter wraps every
+ * few seconds: end times are unwrapped assuming records are written in
+ * completion order and never more than one wrap apart.
+ * @param out Destination (Serial or a chunked HTTP response)
+ */
+void printTrace(Print& out) {
+  uint32_t head = traceHead.load(std::memory_order_acquire);
+  uint32_t count = min(head, TRACE_BUFFER_SIZE);
+  uint32_t cyclesPerUs = ESP.getCpuFreqMHz();
+  uint64_t wraps = 0;
+  uint32_t previousEnd = 0;
+
+  out.print("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (uint32_t i = 0; i < count; i++) {
+    const TraceRecord& record = traceBuffer[(head - count + i) & (TRACE_BUFFER_SIZE - 1)];
+    uint32_t end = record.startCycles + record.durationCycles;
+    if (i > 0 && end < previousEnd) {
+      wraps += 1ULL << 32;
+    }
+    previousEnd = end;
+
+    uint64_t start = wraps + end - record.durationCycles;
+    out.printf("%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+               i > 0 ? "," : "", record.name, record.core,
+               (double)start / cyclesPerUs, (double)record.durationCycles / cyclesPerUs);
+  }
+  out.println("]}");
+}
+
+/**
+ * Dump the trace over serial on the 't' command
+ * @param command Character received on serial, from loop()
+ */
+void handleTraceCommand(char command) {
+  if (command == 't') {
+    Serial.println("TRACE_BEGIN");
+    printTrace(Serial);
+    Serial.println("TRACE_END");
+  }
+}
+
+#else
+
+#define TRACE_ZONE(name)
+
+#endif // ENABLE_TRACING
+
+#endif // TRACE_H
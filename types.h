@@ -1,13 +1,48 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+// 802.11 limits
+const size_t WIFI_SSID_MAX_LENGTH = 32;      // SSID length in bytes
+const size_t WIFI_PASSWORD_MAX_LENGTH = 64;  // WPA passphrase (or PSK in hex)
+
+/**
+ * Fixed-capacity string stored inline, never allocates on the heap
+ * Structures made of FixedString stay trivially copyable, so they can be
+ * copied with memcpy() to NVS blobs or RTC memory
+ * @tparam N Maximum length in characters (terminator not included)
+ */
+template <size_t N>
+struct FixedString {
+  char data[N + 1];
+
+  // Copy a C string, truncating it to the capacity
+  FixedString& operator=(const char* value) {
+    size_t length = value ? strnlen(value, N) : 0;
+    if (length > 0) {
+      memcpy(data, value, length);
+    }
+    data[length] = '\0';
+    return *this;
+  }
+
+  FixedString& operator=(const String& value) {
+    return *this = value.c_str();
+  }
+
+  const char* c_str() const { return data; }
+  size_t length() const { return strnlen(data, N); }
+  bool isEmpty() const { return data[0] == '\0'; }
+  static constexpr size_t capacity() { return N; }
+  operator const char*() const { return data; }
+};
+
 /**
  * Structure to store WiFi network credentials
  * Each network has SSID, password, and enabled status
  */
 struct WiFiNetwork {
-  String ssid;
-  String password;
+  FixedString<WIFI_SSID_MAX_LENGTH> ssid;
+  FixedString<WIFI_PASSWORD_MAX_LENGTH> password;
   bool enabled = false;
 };
 
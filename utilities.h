@@ -1,19 +1,37 @@
 #ifndef UTILITIES_H
 #define UTILITIES_H
 
+#include <algorithm>
+
+// Size of the buffers used by the formatting functions ("YYYY-MM-DD HH:MM:SS")
+const size_t DATE_TIME_BUFFER_SIZE = 20;
+
 // Utility functions
-String formatDateTime(DateTime dt) {
-  char buffer[25];
-  snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d",
+char* formatDateTime(const DateTime& dt, char* buffer, size_t size) {
+  snprintf(buffer, size, "%04d-%02d-%02d %02d:%02d:%02d",
            dt.year(), dt.month(), dt.day(),
            dt.hour(), dt.minute(), dt.second());
-  return String(buffer);
+  return buffer;
+}
+
+char* formatTimeStruct(const struct tm& timeinfo, char* buffer, size_t size) {
+  strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &timeinfo);
+  return buffer;
 }
 
-String formatTimeStruct(struct tm& timeinfo) {
-  char buffer[25];
-  strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
-  return String(buffer);
+/**
+ * Value at the given percentile of a sample array (sorted in place)
+ * @param samples Samples to sort
+ * @param count Number of samples
+ * @param percentile Percentile (0-100)
+ */
+uint32_t computePercentile(uint32_t* samples, uint16_t count, uint8_t percentile) {
+  if (count == 0) {
+    return 0;
+  }
+  std::sort(samples, samples + count);
+  uint16_t index = ((uint32_t)(count - 1) * percentile + 50) / 100;
+  return samples[index];
 }
 
 #endif // UTILITIES_H
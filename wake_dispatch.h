@@ -0,0 +1,70 @@
+#ifndef WAKE_DISPATCH_H
+#define WAKE_DISPATCH_H
+
+/*
+ * External wake dispatch
+ *
+ * Called first thing in setup(): decodes which pin woke the chip (EXT1
+ * status register, or the EXT0 pin) and runs the handler of its role from
+ * the board table right away, before the RTC, WiFi and configuration are
+ * initialized. A cat breaking the door beam while the board sleeps is
+ * therefore seen as a passage start within milliseconds of the wake.
+ *
+ * The wake-to-handler latency (time since the application started) is
+ * printed and exported as a metric.
+ */
+
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include "board.h"
+#include "metrics.h"
+#include "door_sensor.h"
+
+// Global variables
+uint64_t wakePinMask = 0;         // Pins that woke the chip, 0 for other causes
+bool wakeByButton = false;
+
+/**
+ * Role of a GPIO in the board table
+ */
+constexpr PinRole boardPinRole(uint8_t gpio, size_t index = 0) {
+  return index >= SleepPinMasks<Board>::COUNT ? PIN_ROLE_UNUSED
+         : Board::pins[index].gpio == gpio ? Board::pins[index].role
+         : boardPinRole(gpio, index + 1);
+}
+
+/**
+ * Route an external wake to the handler of the pin that caused it
+ * @param wakeReason Wake cause of this boot
+ */
+void dispatchWake(esp_sleep_wakeup_cause_t wakeReason) {
+  if (wakeReason == ESP_SLEEP_WAKEUP_EXT1) {
+    wakePinMask = esp_sleep_get_ext1_wakeup_status();
+  } else if (wakeReason == ESP_SLEEP_WAKEUP_EXT0) {
+    wakePinMask = SleepPinMasks<Board>::WAKE_LOW;
+  }
+  if (wakePinMask == 0) {
+    return;
+  }
+
+  for (uint64_t mask = wakePinMask; mask != 0; mask &= mask - 1) {
+    uint8_t gpio = __builtin_ctzll(mask);
+    switch (boardPinRole(gpio)) {
+      case PIN_ROLE_DOOR_SENSOR:
+        onDoorSensorWake(gpio);
+        break;
+      case PIN_ROLE_BUTTON:
+        wakeByButton = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  metricWakeHandlerLatencyUs = (uint32_t)esp_timer_get_time();
+
+  Serial.printf("Wake dispatched: pins 0x%llx, handler after %lu us\n",
+                (unsigned long long)wakePinMask, (unsigned long)metricWakeHandlerLatencyUs);
+}
+
+#endif // WAKE_DISPATCH_H
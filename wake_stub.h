@@ -0,0 +1,80 @@
+#ifndef WAKE_STUB_H
+#define WAKE_STUB_H
+
+/*
+ * Deep sleep wake stub
+ *
+ * On a timer wake the ROM runs deepSleepWakeStub() from RTC fast memory
+ * before the flash is even mapped. If no work is due yet (idle wakes left
+ * in the RTC memory counter) the stub re-arms the timer and goes straight
+ * back to deep sleep: no bootloader, no static constructors, no
+ * Serial/Wire/RTC initialization. Only when the counter reaches zero, or
+ * on any other wake source (button, sensors), the stub lets the normal
+ * boot proceed.
+ *
+ * Everything the stub touches must live in RTC memory (RTC_DATA_ATTR or
+ * RTC_IRAM_ATTR) and only ROM functions may be called.
+ */
+
+#include <esp_sleep.h>
+#include <esp_wake_stub.h>
+#include <soc/rtc.h>
+#include "sleep_calibration.h"
+
+// Configuration constants
+const uint32_t WAKE_STUB_MAX_IDLE_WAKES = 9;  // Full boot at least every 10 timer periods
+
+// Shared with the stub, kept in RTC slow memory
+RTC_DATA_ATTR uint32_t wakeStubIdleWakes = 0;    // Timer wakes still to absorb in the stub
+RTC_DATA_ATTR uint64_t wakeStubSleepTime = 0;    // Timer period to re-arm (us), calibrated
+RTC_DATA_ATTR uint32_t wakeStubSkippedWakes = 0; // Wakes absorbed since the last full boot
+
+/**
+ * Runs on every deep sleep wake once armed, before the application boots
+ */
+void RTC_IRAM_ATTR deepSleepWakeStub() {
+  uint32_t cause = esp_wake_stub_get_wakeup_cause();
+
+  // Real event or work due: continue with the normal boot
+  if (!(cause & RTC_TIMER_TRIG_EN) || wakeStubIdleWakes == 0) {
+    esp_default_wake_deep_sleep();
+    return;
+  }
+
+  wakeStubIdleWakes--;
+  wakeStubSkippedWakes++;
+
+  // Nothing to do: back to sleep for another period
+  esp_wake_stub_set_wakeup_time(wakeStubSleepTime);
+  esp_wake_stub_sleep(&deepSleepWakeStub);
+}
+
+/**
+ * Arm the wake stub for the next deep sleep
+ * @param sleepDuration Timer period in microseconds
+ * @param idleWakes Timer wakes to skip before the next full boot
+ */
+void armWakeStub(uint64_t sleepDuration, uint32_t idleWakes) {
+  wakeStubSleepTime = calibratedSleepDuration(sleepDuration);
+  wakeStubIdleWakes = min(idleWakes, WAKE_STUB_MAX_IDLE_WAKES);
+
+  // The stub code lives in RTC fast memory, keep it powered
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_FAST_MEM, ESP_PD_OPTION_ON);
+  esp_set_deep_sleep_wake_stub(&deepSleepWakeStub);
+
+  Serial.print("Wake stub armed: ");
+  Serial.print(wakeStubIdleWakes);
+  Serial.println(" idle wakes before next full boot");
+}
+
+/**
+ * Number of wakes absorbed by the stub since the last full boot
+ * Resets the counter, call once per boot
+ */
+uint32_t takeWakeStubSkippedWakes() {
+  uint32_t skipped = wakeStubSkippedWakes;
+  wakeStubSkippedWakes = 0;
+  return skipped;
+}
+
+#endif // WAKE_STUB_H
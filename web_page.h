@@ -1,7 +1,18 @@
 #ifndef WEB_PAGE_H
 #define WEB_PAGE_H
 
-String html = R"HTML(
+/*
+ * Configuration page template
+ *
+ * The page is kept in flash as two chunks. handleRoot() streams the first
+ * chunk, the initial state JSON ({"status":..,"config":..,"networks":..})
+ * and the second chunk, so the page renders from a single request and is
+ * never assembled in RAM. The API endpoints are only used for refreshes
+ * and after saving.
+ */
+
+// Page up to the initial state placeholder
+const char HTML_PAGE_START[] PROGMEM = R"HTML(
 <!DOCTYPE html>
 <html lang="en">
 <head>
@@ -306,14 +317,20 @@ String html = R"HTML(
   </div>
 
   <script>
+    // Initial state rendered by the server, same content as the API responses
+    var initialState = )HTML";
+
+// Rest of the page after the initial state
+const char HTML_PAGE_END[] PROGMEM = R"HTML(;
+
     // Global array to store network configurations
     var networks = [];
     
-    // Initialize the page when it loads
+    // Initialize the page when it loads, from the state embedded in the page
     window.onload = function() {
-      loadStatus();   // Load system status
-      loadConfig();   // Load scheduled action configuration
-      loadNetworks(); // Load WiFi networks
+      showStatus(initialState.status);     // System status
+      showConfig(initialState.config);     // Scheduled action configuration
+      showNetworks(initialState.networks); // WiFi networks
       // Refresh status every 5 seconds
       setInterval(loadStatus, 5000);
     };
@@ -325,21 +342,26 @@ String html = R"HTML(
     function loadStatus() {
       fetch('/api/status')
         .then(function(response) { return response.json(); })
-        .then(function(data) {
-          // Update WiFi status display
-          document.getElementById('wifi-status').textContent = data.wifiConnected ? 'Connected' : 'Disconnected';
-          // Update IP address display
-          document.getElementById('ip-address').textContent = data.ipAddress || 'Not assigned';
-          // Update uptime display
-          document.getElementById('uptime').textContent = formatUptime(data.uptime);
-          // Update memory display
-          document.getElementById('free-memory').textContent = formatMemory(data.freeHeap);
-          
-          // Update system time display
-          var time = data.systemTime;
-          var timeStr = padZero(time.hour) + ':' + padZero(time.minute) + ':' + padZero(time.second);
-          document.getElementById('system-time').textContent = timeStr;
-        });
+        .then(showStatus);
+    }
+    
+    /**
+     * Display system status information
+     */
+    function showStatus(data) {
+      // Update WiFi status display
+      document.getElementById('wifi-status').textContent = data.wifiConnected ? 'Connected' : 'Disconnected';
+      // Update IP address display
+      document.getElementById('ip-address').textContent = data.ipAddress || 'Not assigned';
+      // Update uptime display
+      document.getElementById('uptime').textContent = formatUptime(data.uptime);
+      // Update memory display
+      document.getElementById('free-memory').textContent = formatMemory(data.freeHeap);
+      
+      // Update system time display
+      var time = data.systemTime;
+      var timeStr = padZero(time.hour) + ':' + padZero(time.minute) + ':' + padZero(time.second);
+      document.getElementById('system-time').textContent = timeStr;
     }
     
     /**
@@ -349,14 +371,19 @@ String html = R"HTML(
     function loadConfig() {
       fetch('/api/config')
         .then(function(response) { return response.json(); })
-        .then(function(data) {
-          // Update input fields with current values
-          document.getElementById('action-hour').value = data.actionHour;
-          document.getElementById('action-minute').value = data.actionMinute;
-          // Update scheduled time display
-          var scheduledStr = padZero(data.actionHour) + ':' + padZero(data.actionMinute);
-          document.getElementById('scheduled-time').textContent = scheduledStr;
-        });
+        .then(showConfig);
+    }
+    
+    /**
+     * Display the scheduled action configuration
+     */
+    function showConfig(data) {
+      // Update input fields with current values
+      document.getElementById('action-hour').value = data.actionHour;
+      document.getElementById('action-minute').value = data.actionMinute;
+      // Update scheduled time display
+      var scheduledStr = padZero(data.actionHour) + ':' + padZero(data.actionMinute);
+      document.getElementById('scheduled-time').textContent = scheduledStr;
     }
     
     /**
@@ -366,10 +393,15 @@ String html = R"HTML(
     function loadNetworks() {
       fetch('/api/networks')
         .then(function(response) { return response.json(); })
-        .then(function(data) {
-          networks = data.networks || [];
-          renderNetworks(); // Update the UI
-        });
+        .then(showNetworks);
+    }
+    
+    /**
+     * Store the networks received from the server and render them
+     */
+    function showNetworks(data) {
+      networks = data.networks || [];
+      renderNetworks(); // Update the UI
     }
     
     /**
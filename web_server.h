@@ -18,28 +18,108 @@
 #include <WebServer.h>   // HTTP web server
 #include <Preferences.h> // Non-volatile storage (NVS)
 #include <ArduinoJson.h> // JSON parsing and generation
+#include <type_traits>
 #include "web_page.h"
 #include "types.h"
+#include "config.h"
+#include "actuator.h"
+#include "json_body.h"
+#include "metrics.h"
+#include "trace.h"
+#include "wifi.h"
+#include "selftest.h"
+#include "journal.h"
+#include "stats.h"
+#include "telemetry.h"
 
 // Web server instance running on port 80
 WebServer server(80);
 
-// Preferences object for persistent storage in ESP32 flash memory
-Preferences prefs;
+/**
+ * Print adapter sending a response body in HTTP chunks
+ * Output is collected in a small buffer and flushed with sendContent(),
+ * so large responses are streamed without building them in RAM.
+ * The response must be started with server.setContentLength(CONTENT_LENGTH_UNKNOWN)
+ * and server.send(), and finished with end().
+ */
+class ChunkedPrint : public Print {
+ public:
+  explicit ChunkedPrint(WebServer& server) : server_(server) {}
+
+  size_t write(uint8_t c) override {
+    if (length_ == sizeof(buffer_)) {
+      flush();
+    }
+    buffer_[length_++] = c;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      write(data[i]);
+    }
+    return size;
+  }
+
+  // Send a constant block (flash-resident template) without copying it
+  void sendStatic(const char* data) {
+    flush();
+    server_.sendContent(data, strlen(data));
+  }
+
+  void flush() {
+    if (length_ > 0) {
+      server_.sendContent(buffer_, length_);
+      length_ = 0;
+    }
+  }
+
+  // Send the remaining data and the terminating chunk
+  void end() {
+    flush();
+    server_.sendContent("");
+  }
+
+ private:
+  WebServer& server_;
+  char buffer_[256];
+  size_t length_ = 0;
+};
 
 /**
- * Main system configuration structure
- * Contains scheduled action time and WiFi networks array
+ * Print adapter for JSON embedded in a <script> element
+ * '<' only occurs inside JSON strings, it is written as \u003c so that a
+ * value such as "</script>" cannot end the element
  */
-struct SystemConfig {
-  uint8_t actionHour;        // Hour for scheduled action (0-23)
-  uint8_t actionMinute;      // Minute for scheduled action (0-59)
-  WiFiNetwork networks[5];   // Array of up to 5 WiFi networks
-  uint8_t networkCount;      // Number of configured networks
+class ScriptJsonPrint : public Print {
+ public:
+  explicit ScriptJsonPrint(Print& out) : out_(out) {}
+
+  size_t write(uint8_t c) override {
+    if (c == '<') {
+      out_.print("\\u003c");
+    } else {
+      out_.write(c);
+    }
+    return 1;
+  }
+
+ private:
+  Print& out_;
 };
 
-// Global configuration instance
-SystemConfig config;
+// Preferences object for persistent storage in ESP32 flash memory
+Preferences prefs;
+
+// Size of the NVS key buffers ("enabled" + index), NVS keys are limited to 15 characters
+const size_t NVS_KEY_BUFFER_SIZE = 16;
+
+// Scheduled action already run today, saved in the RTC snapshot
+bool actionExecutedToday = false;
+
+// Fields accepted by the POST endpoints, everything else is skipped while parsing
+JsonDocument configFilter;
+JsonDocument networksFilter;
 
 /**
  * System time structure for basic timekeeping
@@ -66,13 +146,28 @@ void checkScheduledAction();  // Check if scheduled action should execute
 void executeScheduledAction(); // Execute the scheduled action
 void handleRoot();
 void handleGetStatus();       // API: Get system status
+void buildStatusJson(String& response); // Serialize system status
+void buildStatusJson(JsonObject status);   // Fill the system status object
+void buildConfigJson(JsonObject object);   // Fill the configuration object
+void buildNetworksJson(JsonObject object); // Fill the WiFi networks object
 void handleGetConfig();       // API: Get configuration
 void handleSetConfig();       // API: Save configuration
 void handleGetNetworks();     // API: Get WiFi networks
 void handleSetNetworks();     // API: Save WiFi networks
+bool parseNetworksJson(const char* body, size_t length); // Parse networks request body
+void setupJsonFilters();      // Build the request body filters
+void printRequestMemory(uint32_t freeHeapBefore); // Log POST body memory usage
+void receiveRequestBody();    // Collect POST bodies into the bounded buffer
 void handleGetTime();         // API: Get current time
 void handleNotFound();        // Handle 404 errors
+void handleGetMetrics();      // Prometheus metrics
+void handleGetSelfTest();     // API: Run the self-test
+void handleGetEvents();       // API: Query the event journal
+void handleGetStats();        // API: Per-cat daily statistics
+void handleGetHistory();      // API: Downsampled telemetry series
+void handleGetTrace();        // Chrome trace export (ENABLE_TRACING only)
 void saveNetworksToPrefs();   // Save networks to persistent storage
+void initializeConfiguration(bool loadFromNvs); // Open NVS and load the configuration
 void webServerSetup();
 void webServerLoop();
 
@@ -82,27 +177,73 @@ void webServerLoop();
  */
 void setupWebServer() {
   // Main page - serves the HTML interface
-  server.on("/", HTTP_GET, handleRoot);
+  server.on("/", HTTP_GET, timedHandler<ROUTE_ROOT, handleRoot>);
   
-  // REST API endpoints for system interaction
-  server.on("/api/status", HTTP_GET, handleGetStatus);     // GET system status
-  server.on("/api/config", HTTP_GET, handleGetConfig);     // GET configuration
-  server.on("/api/config", HTTP_POST, handleSetConfig);    // POST save configuration
-  server.on("/api/networks", HTTP_GET, handleGetNetworks); // GET WiFi networks
-  server.on("/api/networks", HTTP_POST, handleSetNetworks);// POST save WiFi networks
-  server.on("/api/time", HTTP_GET, handleGetTime);         // GET current time
+  // REST API endpoints for system interaction (wrapped to record their latency)
+  server.on("/api/status", HTTP_GET, timedHandler<ROUTE_STATUS, handleGetStatus>);           // GET system status
+  server.on("/api/config", HTTP_GET, timedHandler<ROUTE_CONFIG_GET, handleGetConfig>);       // GET configuration
+  server.on("/api/config", HTTP_POST, timedHandler<ROUTE_CONFIG_POST, handleSetConfig>,
+            receiveRequestBody);                                                             // POST save configuration
+  server.on("/api/networks", HTTP_GET, timedHandler<ROUTE_NETWORKS_GET, handleGetNetworks>); // GET WiFi networks
+  server.on("/api/networks", HTTP_POST, timedHandler<ROUTE_NETWORKS_POST, handleSetNetworks>,
+            receiveRequestBody);                                                             // POST save WiFi networks
+  server.on("/api/time", HTTP_GET, timedHandler<ROUTE_TIME, handleGetTime>);                 // GET current time
+  server.on("/metrics", HTTP_GET, timedHandler<ROUTE_METRICS, handleGetMetrics>);            // GET Prometheus metrics
+  server.on("/api/selftest", HTTP_GET, timedHandler<ROUTE_SELFTEST, handleGetSelfTest>);     // GET self-test report
+  server.on("/api/events", HTTP_GET, timedHandler<ROUTE_EVENTS, handleGetEvents>);           // GET journal query
+  server.on("/api/stats", HTTP_GET, timedHandler<ROUTE_STATS, handleGetStats>);              // GET cat statistics
+  server.on("/api/history", HTTP_GET, timedHandler<ROUTE_HISTORY, handleGetHistory>);        // GET chart series
+#ifdef ENABLE_TRACING
+  server.on("/api/trace", HTTP_GET, handleGetTrace);                                         // GET Chrome trace JSON
+#endif
   
   // Handle requests to non-existent pages
-  server.onNotFound(handleNotFound);
+  server.onNotFound(timedHandler<ROUTE_NOT_FOUND, handleNotFound>);
+
+  setupJsonFilters();
+}
+
+/**
+ * Build the filters listing the fields each POST endpoint understands
+ */
+void setupJsonFilters() {
+  configFilter["actionHour"] = true;
+  configFilter["actionMinute"] = true;
+
+  JsonObject networkFilter = networksFilter["networks"].add<JsonObject>();
+  networkFilter["ssid"] = true;
+  networkFilter["password"] = true;
+  networkFilter["enabled"] = true;
+}
+
+/**
+ * Upload callback of the POST endpoints: collects the body chunk by chunk
+ */
+void receiveRequestBody() {
+  handleRequestBodyChunk(server);
 }
 
 /**
  * Serve the main HTML page with embedded CSS and JavaScript
  * This creates a complete single-page application
  */
-void handleRoot() {  
-  // Send the complete HTML page to the client
-  server.send(200, "text/html", html);
+void handleRoot() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/html", "");
+
+  // Same content as the API endpoints, so the page needs no further request
+  JsonDocument state;
+  buildStatusJson(state["status"].to<JsonObject>());
+  buildConfigJson(state["config"].to<JsonObject>());
+  buildNetworksJson(state["networks"].to<JsonObject>());
+
+  // Page template from flash with the state in between
+  ChunkedPrint out(server);
+  ScriptJsonPrint stateOut(out);
+  out.sendStatic(HTML_PAGE_START);
+  serializeJson(state, stateOut);
+  out.sendStatic(HTML_PAGE_END);
+  out.end();
 }
 
 /**
@@ -110,30 +251,45 @@ void handleRoot() {
  * Returns current system status including WiFi, IP, uptime, memory, and time
  */
 void handleGetStatus() {
+  String response;
+  buildStatusJson(response);
+  server.send(200, "application/json", response);
+}
+
+/**
+ * Serialize the system status reported by GET /api/status
+ * @param response Destination string for the JSON document
+ */
+void buildStatusJson(String& response) {
   JsonDocument doc;
+  buildStatusJson(doc.to<JsonObject>());
   
+  // Convert JSON to string
+  serializeJson(doc, response);
+}
+
+/**
+ * Fill the system status, shared by GET /api/status and the page
+ * @param status Destination object
+ */
+void buildStatusJson(JsonObject status) {
   // WiFi connection status
-  doc["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
+  status["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
   // Current IP address (empty string if not connected)
-  doc["ipAddress"] = WiFi.localIP().toString();
+  status["ipAddress"] = WiFi.localIP().toString();
   // System uptime in seconds since boot
-  doc["uptime"] = millis() / 1000;
+  status["uptime"] = millis() / 1000;
   // Available heap memory in bytes
-  doc["freeHeap"] = ESP.getFreeHeap();
+  status["freeHeap"] = ESP.getFreeHeap();
   
   // Create nested object for system time
-  JsonObject timeObj = doc["systemTime"].to<JsonObject>();
+  JsonObject timeObj = status["systemTime"].to<JsonObject>();
   timeObj["hour"] = systemTime.hour;
   timeObj["minute"] = systemTime.minute;
   timeObj["second"] = systemTime.second;
   timeObj["year"] = systemTime.year;
   timeObj["month"] = systemTime.month;
   timeObj["day"] = systemTime.day;
-  
-  // Convert JSON to string and send response
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
 }
 
 /**
@@ -142,10 +298,7 @@ void handleGetStatus() {
  */
 void handleGetConfig() {
   JsonDocument doc;
-  
-  // Current scheduled action time
-  doc["actionHour"] = config.actionHour;
-  doc["actionMinute"] = config.actionMinute;
+  buildConfigJson(doc.to<JsonObject>());
   
   // Convert to JSON and send
   String response;
@@ -153,15 +306,27 @@ void handleGetConfig() {
   server.send(200, "application/json", response);
 }
 
+/**
+ * Fill the configuration, shared by GET /api/config and the page
+ * @param object Destination object
+ */
+void buildConfigJson(JsonObject object) {
+  // Current scheduled action time
+  object["actionHour"] = config.actionHour;
+  object["actionMinute"] = config.actionMinute;
+}
+
 /**
  * API Endpoint: POST /api/config
  * Updates the scheduled action configuration and saves to persistent storage
  */
 void handleSetConfig() {
   // Check if request contains JSON data
-  if (server.hasArg("plain")) {
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, server.arg("plain"));
+  if (checkRequestBody(server)) {
+    uint32_t freeHeapBefore = ESP.getFreeHeap();
+    jsonArena.reset();
+    JsonDocument doc(&jsonArena);
+    DeserializationError error = deserializeBoundedJson(doc, requestBody, requestBodyLength, configFilter);
     
     // Parse JSON successfully
     if (!error) {
@@ -172,6 +337,7 @@ void handleSetConfig() {
       // Save configuration to persistent storage (NVS)
       prefs.putUChar("actionHour", config.actionHour);
       prefs.putUChar("actionMinute", config.actionMinute);
+      metricIncrement(COUNTER_NVS_WRITES, 2);
       
       // Send success response
       server.send(200, "application/json", "{\"success\":true}");
@@ -181,14 +347,13 @@ void handleSetConfig() {
       Serial.print(config.actionHour);
       Serial.print(":");
       Serial.println(config.actionMinute);
+      printRequestMemory(freeHeapBefore);
     } else {
       // JSON parsing failed
       server.send(400, "application/json", "{\"success\":false,\"error\":\"Invalid JSON\"}");
     }
-  } else {
-    // No data received
-    server.send(400, "application/json", "{\"success\":false,\"error\":\"No data\"}");
   }
+  releaseRequestBody();
 }
 
 /**
@@ -197,15 +362,7 @@ void handleSetConfig() {
  */
 void handleGetNetworks() {
   JsonDocument doc;
-  JsonArray networksArray = doc["networks"].to<JsonArray>();
-  
-  // Add all configured networks to the response
-  for (uint8_t i = 0; i < config.networkCount && i < 5; i++) {
-    JsonObject network = networksArray.add<JsonObject>();
-    network["ssid"] = config.networks[i].ssid;
-    network["password"] = config.networks[i].password;
-    network["enabled"] = config.networks[i].enabled;
-  }
+  buildNetworksJson(doc.to<JsonObject>());
   
   // Send the networks array
   String response;
@@ -213,34 +370,39 @@ void handleGetNetworks() {
   server.send(200, "application/json", response);
 }
 
+/**
+ * Fill the WiFi networks, shared by GET /api/networks and the page
+ * @param object Destination object, receives the "networks" array
+ */
+void buildNetworksJson(JsonObject object) {
+  JsonArray networksArray = object["networks"].to<JsonArray>();
+  
+  // Add all configured networks
+  for (uint8_t i = 0; i < config.networkCount && i < MAX_NETWORKS; i++) {
+    JsonObject network = networksArray.add<JsonObject>();
+    network["ssid"] = config.networks[i].ssid.c_str();
+    network["password"] = config.networks[i].password.c_str();
+    network["enabled"] = config.networks[i].enabled;
+  }
+}
+
 /**
  * API Endpoint: POST /api/networks
  * Updates the WiFi networks configuration and saves to persistent storage
  */
 void handleSetNetworks() {
   // Check if request contains JSON data
-  if (server.hasArg("plain")) {
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, server.arg("plain"));
-    
+  if (checkRequestBody(server)) {
+    uint32_t freeHeapBefore = ESP.getFreeHeap();
+
     // Parse JSON successfully
-    if (!error) {
-      JsonArray networks = doc["networks"];
-      
-      // Clear existing networks configuration
-      config.networkCount = 0;
-      
-      // Process up to 5 networks from the request
-      for (uint8_t i = 0; i < networks.size() && i < 5; i++) {
-        JsonObject network = networks[i];
-        config.networks[i].ssid = network["ssid"].as<String>();
-        config.networks[i].password = network["password"].as<String>();
-        config.networks[i].enabled = network["enabled"] | false;
-        config.networkCount++;
-      }
-      
+    if (parseNetworksJson(requestBody, requestBodyLength)) {
       // Save networks to persistent storage
       saveNetworksToPrefs();
+
+      // Use the new list without reboot: at once if the station runs,
+      // otherwise at the next station session (the page is served in AP mode)
+      applyWiFiNetworks();
       
       // Send success response
       server.send(200, "application/json", "{\"success\":true}");
@@ -256,14 +418,60 @@ void handleSetNetworks() {
         Serial.print(config.networks[i].enabled ? "enabled" : "disabled");
         Serial.println(")");
       }
+      printRequestMemory(freeHeapBefore);
     } else {
       // JSON parsing failed
       server.send(400, "application/json", "{\"success\":false,\"error\":\"Invalid JSON\"}");
     }
-  } else {
-    // No data received
-    server.send(400, "application/json", "{\"success\":false,\"error\":\"No data\"}");
   }
+  releaseRequestBody();
+}
+
+/**
+ * Parse the body of POST /api/networks into the configuration
+ * Uses the static JSON arena, no heap allocation
+ * @param body JSON request body
+ * @param length Length of the body
+ * @return false if the JSON is invalid (configuration left unchanged)
+ */
+bool parseNetworksJson(const char* body, size_t length) {
+  jsonArena.reset();
+  JsonDocument doc(&jsonArena);
+  DeserializationError error = deserializeBoundedJson(doc, body, length, networksFilter);
+  if (error) {
+    return false;
+  }
+
+  JsonArray networks = doc["networks"];
+  
+  // Clear existing networks configuration
+  config.networkCount = 0;
+  
+  // Process up to MAX_NETWORKS networks from the request
+  for (uint8_t i = 0; i < networks.size() && i < MAX_NETWORKS; i++) {
+    JsonObject network = networks[i];
+    config.networks[i].ssid = network["ssid"] | "";
+    config.networks[i].password = network["password"] | "";
+    config.networks[i].enabled = network["enabled"] | false;
+    config.networkCount++;
+  }
+  return true;
+}
+
+/**
+ * Log the memory used to process a POST body
+ * @param freeHeapBefore Free heap when the handler started
+ */
+void printRequestMemory(uint32_t freeHeapBefore) {
+  Serial.print("Request body: ");
+  Serial.print(requestBodyLength);
+  Serial.print(" bytes | JSON arena peak: ");
+  Serial.print(jsonArena.peak());
+  Serial.print("/");
+  Serial.print(JSON_ARENA_SIZE);
+  Serial.print(" bytes | Heap delta: ");
+  Serial.print((int32_t)(freeHeapBefore - ESP.getFreeHeap()));
+  Serial.println(" bytes");
 }
 
 /**
@@ -287,6 +495,138 @@ void handleGetTime() {
   server.send(200, "application/json", response);
 }
 
+/**
+ * Endpoint: GET /metrics
+ * Returns the metrics registry in the Prometheus text format, streamed in chunks
+ */
+void handleGetMetrics() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+  
+  ChunkedPrint out(server);
+  printMetrics(out);
+  printLifetimeCounters(out);
+  out.end();
+}
+
+/**
+ * API Endpoint: GET /api/selftest
+ * Runs the self-test suite (a few seconds) and returns its report
+ */
+void handleGetSelfTest() {
+  JsonDocument report;
+  runSelfTest(report);
+
+  String response;
+  serializeJson(report, response);
+  server.send(200, "application/json", response);
+}
+
+/**
+ * API Endpoint: GET /api/stats
+ * Returns the per-cat daily statistics, maintained as events arrive
+ */
+void handleGetStats() {
+  JsonDocument doc;
+  buildStatsJson(doc.to<JsonObject>(), currentUnixTime());
+
+  String response;
+  serializeJson(doc, response);
+  server.send(200, "application/json", response);
+}
+
+/**
+ * API Endpoint: GET /api/events?from=&to=&type=&limit=&format=
+ * Streams the journal events in the time range (Unix seconds, inclusive),
+ * optionally of one type (DOOR_ENTRY, ...), as JSON or with format=bin as
+ * the raw 8-byte records (little endian Event). Telemetry types (TEMPERATURE,
+ * ...) are read from the telemetry stream, the others from the events.
+ */
+void handleGetEvents() {
+  JournalQuery query;
+  query.from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : 0;
+  query.to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : UINT32_MAX;
+  query.limit = server.hasArg("limit") ? constrain(server.arg("limit").toInt(), 1, JOURNAL_QUERY_MAX_LIMIT)
+                                       : JOURNAL_QUERY_MAX_LIMIT;
+  query.type = -1;
+  query.stream = JOURNAL_EVENTS;
+  if (server.hasArg("type")) {
+    EventType type = getEventTypeFromString(server.arg("type").c_str());
+    if (type == EVENT_NONE) {
+      server.send(400, "application/json", "{\"success\":false,\"error\":\"Unknown event type\"}");
+      return;
+    }
+    query.type = type;
+    query.stream = isTelemetryEventType(type) ? JOURNAL_TELEMETRY : JOURNAL_EVENTS;
+  }
+
+  bool binary = (server.arg("format") == "bin");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, binary ? "application/octet-stream" : "application/json", "");
+  ChunkedPrint out(server);
+
+  if (binary) {
+    queryJournal(query, [&out](const Event& event) {
+      out.write((const uint8_t*)&event, sizeof(event));
+    });
+  } else {
+    bool first = true;
+    out.print("{\"events\":[");
+    uint16_t count = queryJournal(query, [&out, &first](const Event& event) {
+      out.printf("%s{\"t\":%lu,\"type\":\"%s\",\"subject\":%u,\"value\":%d}", first ? "" : ",",
+                 (unsigned long)event.timestamp, getEventTypeString(event.type), event.subject, event.value);
+      first = false;
+    });
+    out.printf("],\"count\":%u,\"scanned\":%lu}", count, (unsigned long)journalRecordsRead);
+  }
+  out.end();
+}
+
+/**
+ * API Endpoint: GET /api/history?series=&from=&to=&points=
+ * Streams a telemetry series (temperature, battery, rssi, wake, activity) reduced
+ * to at most points points over the time range, the last week by default
+ */
+void handleGetHistory() {
+  HistorySeries series = getHistorySeriesFromString(server.arg("series").c_str());
+  if (series == HISTORY_NONE) {
+    server.send(400, "application/json", "{\"success\":false,\"error\":\"Unknown series\"}");
+    return;
+  }
+
+  uint32_t now = currentUnixTime();
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : now;
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10)
+                                        : (to > HISTORY_DEFAULT_RANGE_S ? to - HISTORY_DEFAULT_RANGE_S : 0);
+  uint16_t points = server.hasArg("points") ? constrain(server.arg("points").toInt(), 2, HISTORY_MAX_POINTS)
+                                            : HISTORY_DEFAULT_POINTS;
+  if (from > to) {
+    server.send(400, "application/json", "{\"success\":false,\"error\":\"Empty time range\"}");
+    return;
+  }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  ChunkedPrint out(server);
+  printHistory(out, series, from, to, points);
+  out.end();
+}
+
+#ifdef ENABLE_TRACING
+/**
+ * API Endpoint: GET /api/trace
+ * Returns the trace buffer in Chrome trace-event JSON, streamed in chunks
+ */
+void handleGetTrace() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  
+  ChunkedPrint out(server);
+  printTrace(out);
+  out.end();
+}
+#endif
+
 /**
  * Handle requests to non-existent pages (404 errors)
  */
@@ -309,16 +649,21 @@ void loadConfiguration() {
   config.networkCount = prefs.getUChar("networkCount", 0);
   
   // Load each WiFi network configuration
-  for (uint8_t i = 0; i < config.networkCount && i < 5; i++) {
+  for (uint8_t i = 0; i < config.networkCount && i < MAX_NETWORKS; i++) {
     // Create unique keys for each network's data
-    String ssidKey = "ssid" + String(i);
-    String passKey = "pass" + String(i);
-    String enabledKey = "enabled" + String(i);
+    char ssidKey[NVS_KEY_BUFFER_SIZE];
+    char passKey[NVS_KEY_BUFFER_SIZE];
+    char enabledKey[NVS_KEY_BUFFER_SIZE];
+    snprintf(ssidKey, sizeof(ssidKey), "ssid%u", i);
+    snprintf(passKey, sizeof(passKey), "pass%u", i);
+    snprintf(enabledKey, sizeof(enabledKey), "enabled%u", i);
     
-    // Load network data with empty defaults
-    config.networks[i].ssid = prefs.getString(ssidKey.c_str(), "");
-    config.networks[i].password = prefs.getString(passKey.c_str(), "");
-    config.networks[i].enabled = prefs.getBool(enabledKey.c_str(), false);
+    // Load network data with empty defaults, directly into the inline buffers
+    config.networks[i].ssid = "";
+    config.networks[i].password = "";
+    prefs.getString(ssidKey, config.networks[i].ssid.data, sizeof(config.networks[i].ssid.data));
+    prefs.getString(passKey, config.networks[i].password.data, sizeof(config.networks[i].password.data));
+    config.networks[i].enabled = prefs.getBool(enabledKey, false);
 
     // Print loaded network info to serial
     Serial.print("Network ");
@@ -348,17 +693,27 @@ void loadConfiguration() {
 void saveNetworksToPrefs() {
   // Save the number of networks
   prefs.putUChar("networkCount", config.networkCount);
+  metricIncrement(COUNTER_NVS_WRITES, 1 + 3 * config.networkCount);
   
   // Save each network's data with unique keys
   for (uint8_t i = 0; i < config.networkCount; i++) {
-    String ssidKey = "ssid" + String(i);
-    String passKey = "pass" + String(i);
-    String enabledKey = "enabled" + String(i);
+    char ssidKey[NVS_KEY_BUFFER_SIZE];
+    char passKey[NVS_KEY_BUFFER_SIZE];
+    char enabledKey[NVS_KEY_BUFFER_SIZE];
+    snprintf(ssidKey, sizeof(ssidKey), "ssid%u", i);
+    snprintf(passKey, sizeof(passKey), "pass%u", i);
+    snprintf(enabledKey, sizeof(enabledKey), "enabled%u", i);
     
     // Store SSID, password, and enabled status
-    prefs.putString(ssidKey.c_str(), config.networks[i].ssid);
-    prefs.putString(passKey.c_str(), config.networks[i].password);
-    prefs.putBool(enabledKey.c_str(), config.networks[i].enabled);
+    {
+      TRACE_ZONE("prefs.putString");
+      prefs.putString(ssidKey, config.networks[i].ssid.c_str());
+    }
+    {
+      TRACE_ZONE("prefs.putString");
+      prefs.putString(passKey, config.networks[i].password.c_str());
+    }
+    prefs.putBool(enabledKey, config.networks[i].enabled);
   }
 }
 
@@ -437,8 +792,6 @@ void updateSystemTime() {
  * Ensures action only executes once per day
  */
 void checkScheduledAction() {
-  static bool actionExecutedToday = false;
-  
   // Reset the daily execution flag at midnight (00:00)
   if (systemTime.hour == 0 && systemTime.minute == 0) {
     actionExecutedToday = false;
@@ -467,24 +820,29 @@ void executeScheduledAction() {
   Serial.print(":");
   Serial.println(systemTime.minute);
   
-  // *** ADD YOUR CUSTOM SCHEDULED ACTION CODE HERE ***
-  // Examples:
-  // - digitalWrite(RELAY_PIN, HIGH);  // Turn on a relay
-  // - sendHttpRequest();              // Send data to web service
-  // - readSensors();                  // Collect sensor data
-  // - sendNotification();             // Send push notification
+  // Open the latch, the move completes in the background (see handleActuator())
+  actuatorOpen(ACTUATOR_TRIGGER_SCHEDULE, (uint32_t)esp_timer_get_time());
   
-  Serial.println("Scheduled action completed!\n");
+  Serial.println("Scheduled action started!\n");
 }
 
-void webServerSetup() {
+/**
+ * Open the NVS namespace and load the saved configuration
+ * Called once at boot, before webServerSetup()
+ * @param loadFromNvs false when config was already restored from the RTC snapshot
+ */
+void initializeConfiguration(bool loadFromNvs) {
   // Initialize the Preferences library for persistent storage
   // "esp32-config" is the namespace, false means read/write access
   prefs.begin("esp32-config", false);
 
   // Load previously saved configuration from flash memory
-  loadConfiguration();
+  if (loadFromNvs) {
+    loadConfiguration();
+  }
+}
 
+void webServerSetup() {
   // Starts the Wi-Fi Access Point
   startAccessPoint();
 
@@ -499,7 +857,10 @@ void webServerSetup() {
 
 void webServerLoop() {
   // Process incoming HTTP requests
-  server.handleClient();
+  {
+    TRACE_ZONE("server.handleClient");
+    server.handleClient();
+  }
 
   // Update internal time counter (increments every second)
   updateSystemTime();
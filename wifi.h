@@ -1,12 +1,32 @@
 #ifndef WIFI_H
 #define WIFI_H
 
+/*
+ * WiFi station connection state machine
+ *
+ * The candidate networks are the enabled entries of config.networks, the
+ * list edited through /api/networks. The compile-time list of secrets.h is
+ * only a fallback while no network is configured. applyWiFiNetworks()
+ * swaps a new list into the running state machine.
+ *
+ * TX power and protocols are set per network by the link manager
+ * (wifi_link.h) from the RSSI recorded on the last connection.
+ */
+
 #include "secrets.h"
+#include "config.h"
+#include "metrics.h"
+#include "lifetime.h"
+#include "trace.h"
+#include "wifi_link.h"
+#include <esp_timer.h>
 
-const uint8_t NUM_NETWORKS = sizeof(networks) / sizeof(networks[0]);
+const uint8_t NUM_SECRET_NETWORKS = sizeof(networks) / sizeof(networks[0]);
+const uint8_t MAX_WIFI_CANDIDATES = (NUM_SECRET_NETWORKS > MAX_NETWORKS) ? NUM_SECRET_NETWORKS : MAX_NETWORKS;
 
 // WiFi Connection State Machine
 enum WiFiState {
+  WIFI_STOPPED,
   WIFI_DISCONNECTED,
   WIFI_CONNECTING,
   WIFI_CONNECTED,
@@ -14,13 +34,23 @@ enum WiFiState {
 };
 
 // Global variables
-WiFiState currentWiFiState = WIFI_DISCONNECTED;
+WiFiState currentWiFiState = WIFI_STOPPED;
 uint8_t currentNetworkIndex = 0;
 uint8_t connectionAttempts = 0;
 uint32_t lastConnectionAttempt = 0;
 uint32_t lastStatusCheck = 0;
 uint32_t connectionStartTime = 0;
 
+// Networks tried in turn, pointing into config.networks or the secrets.h list
+const WiFiNetwork* wifiCandidates[MAX_WIFI_CANDIDATES];
+uint8_t wifiCandidateCount = 0;
+
+// Access point of the last successful connection, saved in the RTC snapshot
+uint8_t wifiCachedNetwork = 0;
+int32_t wifiCachedChannel = 0;     // 0 = nothing cached
+uint8_t wifiCachedBssid[6] = {0};
+int8_t wifiLinkRssi[MAX_WIFI_CANDIDATES] = {0};  // Per candidate, 0 = not measured
+
 // Configuration constants
 const uint8_t MAX_ATTEMPTS_PER_NETWORK = 3;      // Attempts per network before moving to next
 const uint32_t CONNECTION_TIMEOUT = 10000;       // 10 seconds timeout per attempt
@@ -29,7 +59,10 @@ const uint32_t STATUS_CHECK_INTERVAL = 5000;     // Check connection every 5 sec
 const uint32_t RECONNECT_DELAY = 3000;           // Wait 3 seconds before reconnecting
 
 void handleWiFiStateMachine();
+void loadWiFiCandidates();
+void applyWiFiNetworks();
 void startWiFiConnection();
+void stopWiFiConnection();
 void attemptConnection();
 void onConnectionSuccess();
 void onConnectionTimeout();
@@ -44,6 +77,10 @@ void handleWiFiStateMachine() {
   uint32_t currentMillis = millis();
   
   switch (currentWiFiState) {
+    case WIFI_STOPPED:
+      // Radio off, nothing to do until startWiFiConnection()
+      break;
+
     case WIFI_DISCONNECTED:
       // Try to connect to current network
       if (currentMillis - lastConnectionAttempt >= ATTEMPT_DELAY) {
@@ -77,12 +114,77 @@ void handleWiFiStateMachine() {
   }
 }
 
+// Network the state machine is working on
+const WiFiNetwork& currentNetwork() {
+  return *wifiCandidates[currentNetworkIndex];
+}
+
+/**
+ * Build the candidate list from the configuration
+ * Falls back to the secrets.h networks when none is configured and enabled
+ */
+void loadWiFiCandidates() {
+  wifiCandidateCount = 0;
+  for (uint8_t i = 0; i < config.networkCount && i < MAX_NETWORKS; i++) {
+    if (config.networks[i].enabled && !config.networks[i].ssid.isEmpty()) {
+      wifiCandidates[wifiCandidateCount++] = &config.networks[i];
+    }
+  }
+
+  if (wifiCandidateCount == 0) {
+    for (uint8_t i = 0; i < NUM_SECRET_NETWORKS; i++) {
+      wifiCandidates[wifiCandidateCount++] = &networks[i];
+    }
+    Serial.println("No network configured, using the built-in list");
+  }
+}
+
+/**
+ * Swap in the networks of the configuration after it changed
+ * A running connection process restarts on the new list, no reboot needed.
+ * When the station is stopped (always the case while the web server runs
+ * in access point mode) the list is used by the next station session.
+ */
+void applyWiFiNetworks() {
+  loadWiFiCandidates();
+
+  // The cached access point and link data may belong to a network that was removed
+  wifiCachedChannel = 0;
+  memset(wifiLinkRssi, 0, sizeof(wifiLinkRssi));
+  currentNetworkIndex = 0;
+
+  Serial.print("WiFi networks applied: ");
+  Serial.print(wifiCandidateCount);
+  Serial.println(" candidates");
+
+  if (currentWiFiState != WIFI_STOPPED) {
+    forceReconnection();
+  } else {
+    Serial.println("Station stopped, the networks apply from the next connection");
+  }
+}
+
 void startWiFiConnection() {
   Serial.println("Starting WiFi connection process...");
+  loadWiFiCandidates();
   currentWiFiState = WIFI_DISCONNECTED;
-  currentNetworkIndex = 0;
+  currentNetworkIndex = (wifiCachedChannel != 0 && wifiCachedNetwork < wifiCandidateCount) ? wifiCachedNetwork : 0;
   connectionAttempts = 0;
   lastConnectionAttempt = 0;
+
+  // First attempt right away, the association proceeds in the background
+  attemptConnection();
+}
+
+/**
+ * Abort the connection process and switch the radio off
+ * Used when a speculative connection started at boot turns out unneeded
+ */
+void stopWiFiConnection() {
+  Serial.println("WiFi not needed, radio off");
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  currentWiFiState = WIFI_STOPPED;
 }
 
 void attemptConnection() {
@@ -97,33 +199,62 @@ void attemptConnection() {
   connectionStartTime = millis();
   
   Serial.print("Attempting to connect to '");
-  Serial.print(networks[currentNetworkIndex].ssid);
+  Serial.print(currentNetwork().ssid);
   Serial.print("' (attempt ");
   Serial.print(connectionAttempts);
   Serial.print("/");
   Serial.print(MAX_ATTEMPTS_PER_NETWORK);
   Serial.println(")");
   
-  // Start connection attempt
+  // Start connection attempt, at reduced power only while the link is known to be good
   WiFi.mode(WIFI_STA);
-  WiFi.begin(networks[currentNetworkIndex].ssid, networks[currentNetworkIndex].password);
+  prepareLink(connectionAttempts == 1 ? wifiLinkRssi[currentNetworkIndex] : 0);
+  {
+    TRACE_ZONE("WiFi.begin");
+    if (connectionAttempts == 1 && wifiCachedChannel != 0 && currentNetworkIndex == wifiCachedNetwork) {
+      // Known access point: join it directly, without scanning all channels
+      WiFi.begin(currentNetwork().ssid, currentNetwork().password,
+                 wifiCachedChannel, wifiCachedBssid);
+    } else {
+      WiFi.begin(currentNetwork().ssid, currentNetwork().password);
+    }
+  }
   
   currentWiFiState = WIFI_CONNECTING;
 }
 
 void onConnectionSuccess() {
   currentWiFiState = WIFI_CONNECTED;
+  metricIncrement(COUNTER_WIFI_CONNECTS);
+  lifetimeIncrement(LIFETIME_WIFI_SESSIONS);
+  histogramObserve(wifiConnectDuration, (millis() - connectionStartTime) * 1000);
+
+  // Remember the access point for the next wake
+  wifiCachedNetwork = currentNetworkIndex;
+  wifiCachedChannel = WiFi.channel();
+  memcpy(wifiCachedBssid, WiFi.BSSID(), sizeof(wifiCachedBssid));
+
+  // Keep just the power needed by this link for the rest of the session
+  int8_t rssi = WiFi.RSSI();
+  wifiLinkRssi[currentNetworkIndex] = rssi;
+  metricWiFiRssi = rssi;
+  setLinkTxPower(linkTxPowerFor(rssi));
   
   Serial.println("\n✓ WiFi Connected!");
   Serial.print("Connected to: ");
-  Serial.println(networks[currentNetworkIndex].ssid);
+  Serial.println(currentNetwork().ssid);
   Serial.print("IP Address: ");
   Serial.println(WiFi.localIP());
   Serial.print("Signal Strength: ");
-  Serial.print(WiFi.RSSI());
+  Serial.print(rssi);
+  Serial.print(" dBm, TX power ");
+  Serial.print(metricWiFiTxPowerQuarterDbm / 4.0, 1);
   Serial.println(" dBm");
   Serial.print("Total attempts needed: ");
   Serial.println(connectionAttempts);
+  Serial.print("Wake to network ready: ");
+  Serial.print((uint32_t)(esp_timer_get_time() / 1000));
+  Serial.println(" ms");
   Serial.println();
   
   // Reset attempt counter for future use
@@ -132,17 +263,24 @@ void onConnectionSuccess() {
 
 void onConnectionTimeout() {
   Serial.print("✗ Connection timeout for '");
-  Serial.print(networks[currentNetworkIndex].ssid);
+  Serial.print(currentNetwork().ssid);
   Serial.println("'");
   
+  metricIncrement(COUNTER_WIFI_FAILURES);
   WiFi.disconnect();
   currentWiFiState = WIFI_DISCONNECTED;
+
+  // The access point may have moved: scan on the next attempts
+  wifiCachedChannel = 0;
 }
 
 void onConnectionLost() {
   Serial.println("⚠ WiFi connection lost!");
   Serial.print("Last connected to: ");
-  Serial.println(networks[currentNetworkIndex].ssid);
+  Serial.println(currentNetwork().ssid);
+
+  // The link got worse than measured: reconnect at full power
+  wifiLinkRssi[currentNetworkIndex] = 0;
   
   WiFi.disconnect();
   currentWiFiState = WIFI_RECONNECTING;
@@ -156,15 +294,15 @@ void moveToNextNetwork() {
   Serial.println(" failed attempts");
   
   // Move to next network in the list
-  currentNetworkIndex = (currentNetworkIndex + 1) % NUM_NETWORKS;
+  currentNetworkIndex = (currentNetworkIndex + 1) % wifiCandidateCount;
   connectionAttempts = 0;
   
   Serial.print("Now trying network ");
   Serial.print(currentNetworkIndex + 1);
   Serial.print("/");
-  Serial.print(NUM_NETWORKS);
+  Serial.print(wifiCandidateCount);
   Serial.print(": '");
-  Serial.print(networks[currentNetworkIndex].ssid);
+  Serial.print(currentNetwork().ssid);
   Serial.println("'");
   
   // Small delay before trying next network
@@ -181,11 +319,11 @@ void handleStatusCheck() {
     Serial.print("State: ");
     Serial.println(getStateString(currentWiFiState));
     Serial.print("Current network: ");
-    Serial.print(networks[currentNetworkIndex].ssid);
+    Serial.print(currentNetwork().ssid);
     Serial.print(" (");
     Serial.print(currentNetworkIndex + 1);
     Serial.print("/");
-    Serial.print(NUM_NETWORKS);
+    Serial.print(wifiCandidateCount);
     Serial.println(")");
     
     if (currentWiFiState == WIFI_CONNECTED) {
@@ -211,6 +349,7 @@ void handleStatusCheck() {
 // Utility functions
 String getStateString(WiFiState state) {
   switch (state) {
+    case WIFI_STOPPED: return "STOPPED";
     case WIFI_DISCONNECTED: return "DISCONNECTED";
     case WIFI_CONNECTING: return "CONNECTING";
     case WIFI_CONNECTED: return "CONNECTED";
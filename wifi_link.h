@@ -0,0 +1,78 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+/*
+ * WiFi link manager
+ *
+ * The RSSI of each network is recorded when the connection succeeds. The
+ * path loss is about the same in both directions, so the RSSI seen from
+ * the access point tells how much of our TX power is wasted: the power is
+ * stepped down until the expected signal at the access point is just
+ * LINK_MARGIN_DB above LINK_MIN_RSSI. On the next wake the reduced power
+ * is used from the first attempt, association included.
+ *
+ * Strong links are restricted to 802.11g/n in 20 MHz, so the short
+ * uploads use OFDM rates (with the short guard interval when the access
+ * point supports it) instead of falling back to slow 802.11b frames.
+ * A retry or a lost connection restores full power and all protocols.
+ */
+
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include "metrics.h"
+
+// Configuration constants
+const int8_t LINK_MIN_RSSI = -75;          // Weakest signal kept at the access point, dBm
+const int8_t LINK_MARGIN_DB = 10;          // Fading margin above LINK_MIN_RSSI
+const int8_t LINK_FAST_RSSI = -65;         // From this RSSI, 802.11g/n only
+const int8_t LINK_MAX_POWER_DBM = 20;      // Reference, about WIFI_POWER_19_5dBm
+
+// TX power steps accepted by WiFi.setTxPower(), in 0.25 dBm, ascending
+const wifi_power_t LINK_POWER_LEVELS[] = {
+  WIFI_POWER_2dBm, WIFI_POWER_5dBm, WIFI_POWER_7dBm, WIFI_POWER_8_5dBm,
+  WIFI_POWER_11dBm, WIFI_POWER_13dBm, WIFI_POWER_15dBm, WIFI_POWER_17dBm,
+  WIFI_POWER_18_5dBm, WIFI_POWER_19dBm, WIFI_POWER_19_5dBm
+};
+const uint8_t LINK_POWER_LEVEL_COUNT = sizeof(LINK_POWER_LEVELS) / sizeof(LINK_POWER_LEVELS[0]);
+
+/**
+ * Lowest TX power keeping the margin for a measured RSSI
+ * @param rssi RSSI of the access point, dBm
+ */
+wifi_power_t linkTxPowerFor(int8_t rssi) {
+  int32_t excessDb = rssi - (LINK_MIN_RSSI + LINK_MARGIN_DB);
+  int32_t neededQuarterDbm = (LINK_MAX_POWER_DBM - excessDb) * 4;
+
+  for (uint8_t i = 0; i < LINK_POWER_LEVEL_COUNT; i++) {
+    if (LINK_POWER_LEVELS[i] >= neededQuarterDbm) {
+      return LINK_POWER_LEVELS[i];
+    }
+  }
+  return LINK_POWER_LEVELS[LINK_POWER_LEVEL_COUNT - 1];
+}
+
+/**
+ * Set the TX power, station mode must be on
+ * @param power TX power in 0.25 dBm steps
+ */
+void setLinkTxPower(wifi_power_t power) {
+  WiFi.setTxPower(power);
+  metricWiFiTxPowerQuarterDbm = power;
+}
+
+/**
+ * Configure the station for a connection attempt, before WiFi.begin()
+ * The protocols can only be changed while disconnected
+ * @param rssi RSSI recorded for the network, 0 for full power and all protocols
+ */
+void prepareLink(int8_t rssi) {
+  bool known = (rssi != 0);
+  bool fast = known && rssi >= LINK_FAST_RSSI;
+
+  esp_wifi_set_protocol(WIFI_IF_STA, fast ? (WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N)
+                                          : (WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N));
+  esp_wifi_set_bandwidth(WIFI_IF_STA, WIFI_BW_HT20);
+  setLinkTxPower(known ? linkTxPowerFor(rssi) : LINK_POWER_LEVELS[LINK_POWER_LEVEL_COUNT - 1]);
+}
+
+#endif // WIFI_LINK_H